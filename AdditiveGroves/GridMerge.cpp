@@ -0,0 +1,291 @@
+// Additive Groves / GridMerge.cpp: merging of grids of models trained in different directories
+//
+// (c) Daria Sorokina
+
+#include "GridMerge.h"
+#include "LogStream.h"
+#include "functions.h"
+#include "ag_definitions.h"
+#include "ag_functions.h"
+#include "INDdata.h"
+#include "Grove.h"
+#include "GroveStore.h"
+
+#include <sstream>
+#include <sys/types.h>  
+#include <sys/stat.h>   
+
+//Merges grids of models from AGTemp subdirectories of the given directories into AGTemp of the working directory,
+//generates the same output as ag_train. Grids should be trained with the same parameters and different seeds.
+//startTiGN, startAlpha - bottom left corner of the part of the grid to merge
+void mergeGrids(stringv& folders, int startTiGN, double startAlpha)
+{
+	LogStream clog;
+
+	//check that input directories exist
+	int folderN = (int)folders.size();
+	for(int folderNo = 0; folderNo < folderN; folderNo++)
+	{
+		struct stat status;
+		if((stat(folders[folderNo].c_str(), &status) != 0) || !(status.st_mode & S_IFDIR))
+			throw DIR_ERR;
+		//groves in pruned cells are incomplete, such grids cannot be merged
+		if(isPruned(folders[folderNo]))
+			throw PRUNE_ERR;
+	}
+
+//1.a) delete all temp files from the previous run and create a directory AGTemp
+	resetTempDir();
+
+//2. Set parameters from AGTemp/params.txt from the first directory
+	TrainInfo ti;			//set of model parameters in the current directory
+	double prevBest;		//best value of performance achieved on the previous run
+			
+	fstream fparam;
+	string paramPathName = folders[0] + "/AGTemp/params.txt";
+	fparam.open(paramPathName.c_str(), ios_base::in); 
+	string modeStr, metric;
+	fparam >> ti.seed >> ti.trainFName >> ti.validFName >> ti.attrFName >> ti.minAlpha >> ti.maxTiGN 
+		>> ti.bagN >> modeStr >> metric;	
+
+	//modeStr should be "fast" or "slow" or "layered"	
+	if(modeStr.compare("fast") == 0)
+		ti.mode = FAST;
+	else if(modeStr.compare("slow") == 0)
+		ti.mode = SLOW;
+	else if(modeStr.compare("layered") == 0)
+		ti.mode = LAYERED;
+	else
+		throw TEMP_ERR;
+
+	//metric should be "roc" or "rms"
+	if(metric.compare("rms") == 0)
+		ti.rms = true;
+	else if(metric.compare("roc") == 0)
+		ti.rms = false;
+	else
+		throw TEMP_ERR;
+
+	if(fparam.fail())
+		throw TEMP_ERR;
+	readConvParams(fparam, ti);
+	fparam.close();
+	fparam.clear();
+
+	//read best value of performance on previous run
+	fstream fbest;
+	double stub;
+	int itemN; // number of data points in the train set, need to calculate possible values of alpha
+	string fbestPathName = folders[0] + "/AGTemp/best.txt";
+	fbest.open(fbestPathName.c_str(), ios_base::in); 
+	fbest >> prevBest >> stub >> stub >> stub >> itemN;
+	if(fbest.fail())
+		throw TEMP_ERR;
+	fbest.close();
+
+	int alphaN = getAlphaN(ti.minAlpha, itemN); //number of different alpha values
+	int tigNN = getTiGNN(ti.maxTiGN);
+
+	//direction of initialization (1 - up, 0 - right), used in fast mode only
+	doublevv dir(tigNN, doublev(alphaN, 0)); 
+	//outer array: column (by TiGN)
+	//middle array: row	(by alpha)
+	
+	//direction of initialization (1 - up, 0 - right), collects average in the slow mode
+	doublevv dirStat(tigNN, doublev(alphaN, 0));
+
+	if(ti.mode == FAST)
+	{//read part of the directions table from file
+		fstream fdir;
+		string fdirPathName = folders[0] + "/AGTemp/dir.txt";
+		fdir.open(fdirPathName.c_str(), ios_base::in); 
+		for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
+			for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+				fdir >> dir[tigNNo][alphaNo];
+		if(fdir.fail())
+			throw TEMP_ERR;
+		fdir.close();
+	}
+
+//3. Read main parameters from all other directories and check that they match
+
+	int allBagN = ti.bagN;
+	intv bagNs(folderN, 0);
+	bagNs[0] = ti.bagN;
+	intv prevBagNs(folderN + 1, 0); //sums of bagNs of all previous directories
+	prevBagNs[1] = ti.bagN;
+	int lastSeed = ti.seed;
+	for(int folderNo = 1; folderNo < folderN; folderNo++)
+	{
+		TrainInfo extraTI;	//set of model parameters in the additional directory
+		
+		string fparamPathName = folders[folderNo] + "/AGTemp/params.txt";
+		fparam.open(fparamPathName.c_str(), ios_base::in); 
+		fparam >> extraTI.seed >> extraTI.trainFName >> extraTI.validFName >> extraTI.attrFName 
+			>> extraTI.minAlpha >> extraTI.maxTiGN >> extraTI.bagN;	
+
+		if(fparam.fail())
+		{
+			clog << fparamPathName << '\n';
+			throw TEMP_ERR;
+		}
+		fparam.close();
+
+		if((ti.minAlpha != extraTI.minAlpha) || (ti.maxTiGN != extraTI.maxTiGN))
+		  {
+		    clog << fparamPathName << '\n';
+			throw MERGE_MISMATCH_ERR;
+		  }
+		if(extraTI.seed == ti.seed)
+			throw SAME_SEED_ERR;
+		if(folderNo == (folderN - 1))
+			lastSeed = extraTI.seed;
+
+		allBagN += extraTI.bagN;
+		bagNs[folderNo] = extraTI.bagN;
+		prevBagNs[folderNo + 1] = allBagN;
+
+		string fdirStatPathName = folders[folderNo] + "/AGTemp/dirstat.txt";
+		fstream fdirStat;	
+		fdirStat.open(fdirStatPathName.c_str(), ios_base::in);
+		for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+			for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
+			{
+				double ds;
+				fdirStat >> ds;
+				dirStat[tigNNo][alphaNo] += ds * extraTI.bagN;
+			}
+	}
+
+//4. Load data
+	INDdata data("", ti.validFName.c_str(), "", ti.attrFName.c_str());
+	CGrove::setData(data);
+	CTreeNode::setData(data);
+
+	doublev validTar;
+	int validN = data.getTargets(validTar, VALID);
+
+	clog << "Alpha = " << ti.minAlpha << "\nN = " << ti.maxTiGN << "\n" 
+		<< allBagN << " bagging iterations\n";
+	if(ti.mode == FAST)
+		clog << "fast mode\n\n";
+	else if(ti.mode == SLOW)
+		clog << "slow mode\n\n";
+	else //if(ti.mode == LAYERED)
+		clog << "layered mode\n\n";
+
+	//5. Initialize some internal process variables
+
+	//surfaces of performance values for validation set. 
+	//Always calculate rms (for convergence analysis), if needed, calculate roc
+	doublevvv rmsV(tigNN, doublevv(alphaN, doublev(allBagN, 0))); 
+	doublevvv rocV;
+	if(!ti.rms)
+		rocV.resize(tigNN, doublevv(alphaN, doublev(allBagN, 0))); 
+	//outer array: column (by TiGN)
+	//middle array: row (by alpha)
+	//inner array: bagging iterations. Performance is kept for all iterations to create bagging curves
+
+	//sums of predictions for each data point (raw material to calculate performance)
+	doublevvv predsumsV(tigNN, doublevv(alphaN, doublev(validN, 0)));
+	//outer array: column (by TiGN)
+	//middle array: row	(by alpha)
+	//inner array: data points in the validation set
+	
+
+//6. Read and merge models from the directories
+	int startAlphaNo = getAlphaN(startAlpha, itemN) - 1; 
+	int startTiGNNo = getTiGNN(startTiGN) - 1;
+
+	//stores of groves in the input directories and in the output directory
+	vector<CGroveStore*> inStores(folderN);
+	for(int folderNo = 0; folderNo < folderN; folderNo++)
+		inStores[folderNo] = new CGroveStore(folders[folderNo] + "/AGTemp");
+	CGroveStore outStore(workPath("AGTemp"));
+	outStore.clear();
+
+	for(int alphaNo = startAlphaNo; alphaNo < alphaN; alphaNo++)
+	{
+		double alpha;
+		if(alphaNo < alphaN - 1)
+			alpha = alphaVal(alphaNo);
+		else	//this is a special case because minAlpha can be zero
+			alpha = ti.minAlpha;
+
+		cout << "Merging models with alpha = " << alpha << endl;
+
+		for(int tigNNo = startTiGNNo; tigNNo < tigNN; tigNNo++) 
+		{
+			int tigN = tigVal(tigNNo);	//number of trees in the current grove
+
+			//prefix of temp files related to alpha and tigN
+			string prefix = string("AGTemp/ag.a.") 
+								+ alphaToStr(alpha)
+								+ ".n." 
+								+ itoa(tigN, 10);
+
+			for(int folderNo = 0; folderNo < folderN; folderNo++)
+			{
+				string inStoreFName = folders[folderNo] + "/AGTemp/groves.bin";
+				if(inStores[folderNo]->getBagN(alpha, tigN) < bagNs[folderNo])
+				{
+				    clog << inStoreFName << '\n';
+					throw TEMP_ERR;
+				}
+			
+				//merge all extra models with the same (alpha, tigN) parameter values into existing models
+				for(int bagNo = prevBagNs[folderNo]; bagNo < prevBagNs[folderNo + 1]; bagNo++)
+				{
+					//retrieve next grove
+					string groveBuf;
+					inStores[folderNo]->read(groveBuf, alpha, tigN, bagNo - prevBagNs[folderNo]);
+					CGrove extraGrove(alpha, tigN);
+					istringstream fload(groveBuf);
+					try{
+					extraGrove.load(fload);
+					}catch(TE_ERROR err){
+					  clog << inStoreFName << '\n';
+					  throw err;
+					}
+					//add the grove to the output store as it is
+					outStore.add(alpha, tigN, groveBuf);
+
+					//generate predictions and performance for validation set
+					doublev predictions(validN);
+					for(int itemNo = 0; itemNo < validN; itemNo++)
+					{
+						predsumsV[tigNNo][alphaNo][itemNo] += extraGrove.predict(itemNo, VALID);
+						predictions[itemNo] = predsumsV[tigNNo][alphaNo][itemNo] / (bagNo + 1);
+					}
+					if(bagNo == allBagN - 1)
+					{
+						string predsFName = prefix + ".preds.txt";
+						fstream fpreds(workPath(predsFName).c_str(), ios_base::out);
+						for(int itemNo = 0; itemNo < validN; itemNo++)
+							fpreds << predictions[itemNo] << endl;
+						fpreds.close();
+					}
+
+					rmsV[tigNNo][alphaNo][bagNo] = rmse(predictions, validTar);
+					if(!ti.rms)
+						rocV[tigNNo][alphaNo][bagNo] = roc(predictions, validTar);
+
+				}// end for(int bagNo = ti.bagN; bagNo < ti.bagN + extraTI.bagN; bagNo++)
+			}//end for(int folderNo = 0; folderNo < folderN; folderNo++)
+
+			//save all groves of the cell with a single write
+			outStore.flush();
+		}//end for(int tigNNo = 0; tigNNo < tigNN; tigNNo++) 
+	}//end for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+
+	for(int folderNo = 0; folderNo < folderN; folderNo++)
+		delete inStores[folderNo];
+
+	//4. Output
+	ti.bagN = allBagN;
+	ti.seed = lastSeed;
+	if(ti.rms)
+		trainOut(ti, dir, rmsV, rmsV, predsumsV, itemN, dirStat, startAlphaNo, startTiGNNo);
+	else
+		trainOut(ti, dir, rmsV, rocV, predsumsV, itemN, dirStat, startAlphaNo, startTiGNNo);
+}
@@ -0,0 +1,9 @@
+// Additive Groves / GridMerge.h: merging of grids of models trained in different directories
+//
+// (c) Daria Sorokina
+
+#pragma once
+#include "definitions.h"
+
+//merges grids of models from several directories into the working directory, used by ag_merge and ag_dist
+void mergeGrids(stringv& folders, int startTiGN = 1, double startAlpha = 0.5);
@@ -12,6 +12,9 @@
 #include <iostream>
 
 INDdata* CGrove::pData;
+double CGrove::convTol = 0.002;
+int CGrove::maxRounds = 0;
+bool CGrove::oobStop = false;
 #ifndef _WIN32
 TThreadPool* CGrove::pPool;
 
@@ -42,48 +45,85 @@ public:
 		else
 			*pJD->pToDoN -= 1;
 		
-		nodesCond.Unlock();
 		nodesCond.Signal();
+		nodesCond.Unlock();
+
+		delete pJD;
+    }
+};
+
+//job class, evaluates a restricted tree on out of bag data, used for multithreading in unix
+class CTreeEvalJob : public TThreadPool::TJob
+{
+public:
+    
+    CTreeEvalJob() : TThreadPool::TJob() { }
+    
+    void Run(void* ptr)
+    {
+		EvalJobData* pJD = (EvalJobData*) ptr;
+		double perf = pJD->pGrove->oobPerf(*pJD->pRoot, *pJD->pOutOfBag, *pJD->pSinOOBTar);
+
+		TCondition& evalCond = *pJD->pCond;
+		evalCond.Lock();
+		*pJD->pPerf = perf;
+		*pJD->pToDoN -= 1;
+		evalCond.Signal();
+		evalCond.Unlock();
 
 		delete pJD;
     }
 };
 #endif
 
-CGrove::CGrove(double alphaIn, int tigNIn): alpha(alphaIn), tigN(tigNIn), roots(tigNIn)
+CGrove::CGrove(double alphaIn, int tigNIn): alpha(alphaIn), tigN(tigNIn), roots(tigNIn), pBag(NULL), 
+	allocN(0), rebuildN(0), roundN(0), seed(0)
 {
 }
 
 CGrove::CGrove(double alphaIn, int tigNIn, intv& interactionIn): 
-	alpha(alphaIn), tigN(tigNIn), roots(tigNIn), interaction(interactionIn)
+	alpha(alphaIn), tigN(tigNIn), roots(tigNIn), pBag(NULL), interaction(interactionIn), 
+	allocN(0), rebuildN(0), roundN(0), seed(0)
 {
 }
 
+//Makes sure that a working buffer can hold size elements without reallocation
+//returns 1 if memory had to be allocated, 0 otherwise
+template<class T> 
+int reserveBuf(vector<T>& buf, int size)
+{
+	if((int)buf.capacity() >= size)
+		return 0;
+	buf.reserve(size);
+	return 1;
+}
+
 //Builds the (tigN, alpha) grove with previous grove (represented by sinpreds and jointpreds) 
 //as a starting point. Keeps regrowing trees until convergence. Returns rmse on on bag data and on oob data.
-//in:	sinpreds - predictions of single trees on the training set
+//in:	sinpreds - predictions of single trees on the training set, stored in single precision to save memory. 
+//			Should have at least tigN rows
 //		jointpreds - predictions of the whole grove on the training set
-ddpair CGrove::converge(doublevv& sinpreds, doublev& jointpreds)
+ddpair CGrove::converge(floatvv& sinpreds, doublev& jointpreds)
 {
+	//buffers of the grove are reused between calls, allocate them only once
+	int trainN = pData->getTrainN();
+	allocN += reserveBuf(outofbag, trainN) + reserveBuf(oobtar, trainN) + reserveBuf(oobpreds, trainN)
+		+ reserveBuf(bag, trainN) + reserveBuf(bagtar, trainN) + reserveBuf(bagpreds, trainN);
 
 	//get out of bag data
-	intv outofbag;	//indexes
-	doublev oobtar;	//targets
-	int oobN = pData->getOutOfBag(outofbag, oobtar);
+	int oobN = getOutOfBag(outofbag, oobtar);
 			
 	//get current bag of data
-	intv bag;		//indexes
-	doublev bagtar; //targets
-	int itemN = pData->getCurBag(bag, bagtar);
+	int itemN = pBag ? pBag->getCurBag(bag, bagtar) : pData->getCurBag(bag, bagtar);
 
 	//calculate previous oob rmse - rmse of the original grove on current oob data
-	doublev oobpreds(oobN);
+	oobpreds.resize(oobN);
 	for(int oobNo = 0; oobNo < oobN; oobNo++)
 		oobpreds[oobNo] = jointpreds[outofbag[oobNo]];
 	double oobPrevRMS = rmse(oobpreds, oobtar);	
 
 	//calculate previous bag rmse - rmse of the original grove on current bag data
-	doublev bagpreds(itemN);
+	bagpreds.resize(itemN);
 	for(int itemNo = 0; itemNo < itemN; itemNo++)
 		bagpreds[itemNo] = jointpreds[bag[itemNo]];
 	double bagPrevRMS = rmse(bagpreds, bagtar);	
@@ -91,8 +131,11 @@ ddpair CGrove::converge(doublevv& sinpreds, doublev& jointpreds)
 	//rebuild the trees in turn until the changes will be unsignificant
 	double oobRMS;	//rmse on oob data
 	double bagRMS;	//rmse on bag data
+	roundN = 0;
 	while(true)
 	{
+		roundN++;
+
 		//rebuild one tree
 		for(int treeNo = 0; treeNo < tigN; treeNo++)
 		{
@@ -112,11 +155,14 @@ ddpair CGrove::converge(doublevv& sinpreds, doublev& jointpreds)
 
 		//check the endofloop condition - negative or small changes in rmse
 		//first check in bag results, then (if bag preds are ideal) check results on oob data
-		bool bag_converged = (bagPrevRMS - bagRMS) / bagPrevRMS <= 0.002;
-		bool oob_converged = (oobPrevRMS - oobRMS) / oobPrevRMS <= 0.002; 
+		//in oobStop mode, oob results are checked always
+		//the loop also ends when the max number of rounds is reached
+		bool bag_converged = (bagPrevRMS - bagRMS) / bagPrevRMS <= convTol;
+		bool oob_converged = (oobPrevRMS - oobRMS) / oobPrevRMS <= convTol; 
 
 		if((bagRMS != 0) && bag_converged ||
-			(bagRMS == 0) && ((oobRMS == 0) || oob_converged))
+			((bagRMS == 0) || oobStop) && ((oobRMS == 0) || oob_converged) ||
+			(maxRounds > 0) && (roundN >= maxRounds))
 			return ddpair(bagRMS, oobRMS);
 		else
 		{
@@ -134,7 +180,7 @@ void CGrove::trainLayered()
 	int alphaN = getAlphaN(minAlpha, itemN);	//number of different alpha values to use
 
 	doublev jointpreds(itemN, 0);	//prediction of the whole grove on the train set data points 
-	doublevv sinpreds(tigN, doublev(itemN, 0));	//predictions by tree 
+	floatvv sinpreds(tigN, floatv(itemN, 0));	//predictions by tree 
 
 	for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
 	{
@@ -151,17 +197,24 @@ void CGrove::trainLayered()
 //Generates a tree as part of training the whole additive grove 
 //in-out: sinpredsx - predictions of this tree 
 //in-out: jointpreds - predictions of the whole grove (sum of trees)
-void CGrove::genTreeInGrove(doublev& sinpredsx, doublev& jointpreds, int treeNo)
+void CGrove::genTreeInGrove(floatv& sinpredsx, doublev& jointpreds, int treeNo)
 {
 	int itemN = pData->getTrainN(); 
-	doublev othpreds(itemN); //prediction of all other trees
-	
-	//calculate joint prediction of other trees
+	rebuildN++;
+
+	//residuals are maintained in place: while the tree is rebuilt, jointpreds keeps 
+	//joint prediction of other trees
+	doublev& othpreds = jointpreds;
 	for(int itemNo = 0; itemNo < itemN; itemNo++)
-		othpreds[itemNo] = jointpreds[itemNo] - sinpredsx[itemNo];
+		othpreds[itemNo] -= sinpredsx[itemNo];
 	
 	//initialize the root
-	roots[treeNo].setRoot();
+	if(pBag)
+		roots[treeNo].setRoot(*pBag);
+	else
+		roots[treeNo].setRoot();
+	roots[treeNo].setSeed(mix32(seed + rebuildN));
+	roots[treeNo].setKeepLeafItems(true);	//leaves are used by leafPredict below
 	roots[treeNo].resetRoot(othpreds);
 
 	//build tree
@@ -171,15 +224,69 @@ void CGrove::genTreeInGrove(doublev& sinpredsx, doublev& jointpreds, int treeNo)
 		chooseTree(roots[treeNo], othpreds);
 
 	//recalculate single predictions of this tree and joint predictions of the grove
+	//in-bag items: use leaves they were assigned to during training, out-of-bag items: traverse the tree
+	allocN += reserveBuf(leafMarks, itemN);
+	leafMarks.assign(itemN, -1);	//number of the last leaf that contributed to the prediction of the item
+	leafPredict(roots[treeNo], sinpredsx, leafMarks);
 	for(int itemNo = 0; itemNo < itemN; itemNo++)
 	{
-		sinpredsx[itemNo] = localPredict(roots[treeNo], itemNo, TRAIN);
+		if(leafMarks[itemNo] == -1)
+			sinpredsx[itemNo] = (float)localPredict(roots[treeNo], itemNo, TRAIN);
 		jointpreds[itemNo] = othpreds[itemNo] + sinpredsx[itemNo];
 	}
 }
 
+//Calculates predictions of a freshly trained tree for train set items in the bag, using lists of items 
+//attached to leaves during training. Frees these lists afterwards.
+//in-out: sinpredsx - predictions of the tree, only values for items in the bag are changed
+//out: leafMarks - number of the last leaf containing the item, -1 for items that are not in the bag. 
+//	Should be initialized with -1. Is used to count an item only once when it appears in the bag several times
+void CGrove::leafPredict(CTreeNode& root, floatv& sinpredsx, intv& leafMarks)
+{
+	stack<CTreeNode*> nodes;	//stack of nodes that are not visited yet
+	nodes.push(&root);
+	int leafNo = 0;
+	while(!nodes.empty())
+	{
+		CTreeNode* pNode = nodes.top();
+		nodes.pop();
+		if(!pNode->isLeaf())
+		{
+			nodes.push(pNode->left);
+			nodes.push(pNode->right);
+			continue;
+		}
+
+		//add the prediction of the leaf to all items that ended up there
+		ItemInfov* pItems = pNode->getLeafItems();
+		if(pItems == NULL)
+			continue;
+		double resp = pNode->getResp();
+		for(ItemInfov::iterator itemIt = pItems->begin(); itemIt != pItems->end(); itemIt++)
+		{
+			int key = itemIt->key;
+			if(leafMarks[key] == leafNo)
+				continue; //a copy of the same item in the bag, it is already counted
+			if(leafMarks[key] == -1)
+				sinpredsx[key] = 0;
+			sinpredsx[key] += (float)(itemIt->coef * resp);
+			leafMarks[key] = leafNo;
+		}
+		pNode->clearLeafItems();
+		leafNo++;
+	}
+}
+
 //Grows the tree. Assumes that the root is all set (contains train set, attrs, etc.).
 void CGrove::growTree(CTreeNode& root)
+{
+	CTreeNodepv roots(1, &root);
+	growTrees(roots);
+}
+
+//Grows several trees at the same time. Assumes that all roots are set (contain train set, attrs, etc.).
+//Nodes of all trees are processed from a single stack, so independent trees are built in parallel
+void CGrove::growTrees(CTreeNodepv& roots)
 {	
 	double b = - log((double) pData->getTrainN()) / log(2.0);
 	double H = - log((double) alpha) / log(2.0);
@@ -187,12 +294,14 @@ void CGrove::growTree(CTreeNode& root)
 	if(b >= -H)
 		b = -H;
 
-	//place root into the stack of nodes for splitting
+	//place roots into the stack of nodes for splitting
 	nodehstack nodes;	//stack
-	nodes.push(nodeip(&root, 0));
+	int rootN = (int)roots.size();
+	for(int rootNo = 0; rootNo < rootN; rootNo++)
+		nodes.push(nodeip(roots[rootNo], 0));
 
 #ifdef _WIN32	
-	//grow the tree: take nodes from the stack, try to split them, 
+	//grow the trees: take nodes from the stack, try to split them, 
 	//if the result is positive, place child nodes into the same stack
 	while(!nodes.empty())
 	{
@@ -210,7 +319,7 @@ void CGrove::growTree(CTreeNode& root)
 	}
 #else
 	//multithreaded version of the same process
-	int toDoN = 1; //how many nodes exists but have not been finished processing at the moment
+	int toDoN = rootN; //how many nodes exists but have not been finished processing at the moment
 	while(toDoN > 0)
 	{
 		nodesCond.Lock();
@@ -237,7 +346,7 @@ void CGrove::chooseTree(CTreeNode& root, doublev& othpreds)
 	//get out of bag data
 	intv outofbag;	//indexes
 	doublev oobtar;	//targets
-	int oobN = pData->getOutOfBag(outofbag, oobtar);
+	int oobN = getOutOfBag(outofbag, oobtar);
 	doublev sinoobtar(oobN, 0);
 	for(int oobNo = 0; oobNo < oobN; oobNo++)
 		sinoobtar[oobNo] = oobtar[oobNo] - othpreds[outofbag[oobNo]];
@@ -245,18 +354,33 @@ void CGrove::chooseTree(CTreeNode& root, doublev& othpreds)
 	int interN = (int)interaction.size(); //order of interactions, number of variables to test
 	doublev rPerfs(interN, 1); //performance of restricted trees
 
-	//build interN restricted trees on the same train set 
+	//build interN restricted trees on the same train set, all at the same time
 	CTreeNodev rRoots(interN, root);
+	CTreeNodepv pRRoots(interN);
 	for(int interNo = 0; interNo < interN; interNo++)
 	{
 		rRoots[interNo].delAttr(interaction[interNo]);
-		growTree(rRoots[interNo]);
+		pRRoots[interNo] = &rRoots[interNo];
+	}
+	growTrees(pRRoots);
 
-		doublev sinoobpreds(oobN, 0);
-		for(int oobNo = 0; oobNo < oobN; oobNo++)
-			sinoobpreds[oobNo] = localPredict(rRoots[interNo], outofbag[oobNo], TRAIN);
-		rPerfs[interNo] = rmse(sinoobpreds, sinoobtar);													
+	//evaluate restricted trees on out of bag data
+#ifdef _WIN32
+	for(int interNo = 0; interNo < interN; interNo++)
+		rPerfs[interNo] = oobPerf(rRoots[interNo], outofbag, sinoobtar);
+#else
+	int toDoN = interN;	//number of trees that are not evaluated yet
+	for(int interNo = 0; interNo < interN; interNo++)
+	{
+		EvalJobData* pJD = new EvalJobData(this, &rRoots[interNo], &outofbag, &sinoobtar, 
+			&rPerfs[interNo], &nodesCond, &toDoN);
+		pPool->Run(new CTreeEvalJob(), pJD, true);
 	}
+	nodesCond.Lock();
+	while(toDoN > 0)
+		nodesCond.Wait();
+	nodesCond.Unlock();
+#endif
 	
 	//insert the winning tree and its results into grove building process
 	int bestNo = min_element(rPerfs.begin(), rPerfs.end()) - rPerfs.begin();
@@ -265,9 +389,24 @@ void CGrove::chooseTree(CTreeNode& root, doublev& othpreds)
 	rRoots[bestNo].right = NULL;
 }
 
+//Calculates rmse of a single tree on out of bag data
+double CGrove::oobPerf(CTreeNode& root, intv& outofbag, doublev& sinoobtar)
+{
+	int oobN = (int)outofbag.size();
+	doublev sinoobpreds(oobN, 0);
+	for(int oobNo = 0; oobNo < oobN; oobNo++)
+		sinoobpreds[oobNo] = localPredict(root, outofbag[oobNo], TRAIN);
+	return rmse(sinoobpreds, sinoobtar);
+}
+
 //Calculates predictions of one of the trees for one item
 double CGrove::localPredict(CTreeNode& root, int itemNo, DATA_SET dset)
 {
+	//most cases have no missing values on their path and end up in a single leaf with coefficient 1
+	CTreeNode* pLeaf = root.findLeaf(pData->getRow(itemNo, dset));
+	if(pLeaf)
+		return pLeaf->getResp();
+
 	//Implementation note: because of missing values, the item can end up in several leaves with
 	//different coefficients. We trace which nodes it visits and what coefficients it has in each
 	//node
@@ -317,11 +456,26 @@ double CGrove::localPredict(CTreeNode& root, int itemNo, DATA_SET dset)
 	return ret;
 }
 
-//Saves the grove into the binary file. 
-//Nodes of each tree are packed into the file in preorder. Trees are packed consecutively.
+//Gets out of bag data of the bag the grove is trained on
+int CGrove::getOutOfBag(intv& oobData, doublev& oobTar)
+{
+	if(pBag)
+		return pBag->getOutOfBag(oobData, oobTar);
+	return pData->getOutOfBag(oobData, oobTar);
+}
+
+//Appends the grove to the binary file
 void CGrove::save(const char* fileName)
 {
 	fstream fsave(fileName, ios_base::binary | ios_base::out | ios_base::app);	//file
+	save(fsave);
+	fsave.close();
+}
+
+//Saves the grove into a binary stream. 
+//Nodes of each tree are packed into the stream in preorder. Trees are packed consecutively.
+void CGrove::save(ostream& fsave)
+{
 	for(int treeNo = 0; treeNo < tigN; treeNo++)
 	{
 		stack<CTreeNode*> nodes;	//stack for keeping roots of subtrees in the packing order
@@ -338,12 +492,11 @@ void CGrove::save(const char* fileName)
 			}
 		}
 	}
-	fsave.close();
 }
 
 //Loads the grove from the binary file. 
 //Nodes of each tree are packed into the file in preorder. Trees are packed consecutively.
-void CGrove::load(fstream& fload)
+void CGrove::load(istream& fload)
 {
 	for(int treeNo = 0; treeNo < tigN; treeNo++)
 	{
@@ -382,9 +535,17 @@ double CGrove::predict(int itemNo, DATA_SET dset)
 	return prediction;
 }
 
+//adds the grove to a compiled model as a new group of trees
+void CGrove::compile(CCompiledModel& model)
+{
+	model.addGroup();
+	for(int treeNo = 0; treeNo < tigN; treeNo++)
+		model.addTree(roots[treeNo]);
+}
+
 //returns predictions of single trees and the whole model for all data points in the train set
 //in-out vectors should be already initialized with correct sizes
-void CGrove::batchPredict(doublevv& sinpreds, doublev& jointpreds)
+void CGrove::batchPredict(floatvv& sinpreds, doublev& jointpreds)
 {
 	int itemN = pData->getTrainN();
 	for(int itemNo = 0; itemNo < itemN; itemNo++)
@@ -392,51 +553,8 @@ void CGrove::batchPredict(doublevv& sinpreds, doublev& jointpreds)
 		jointpreds[itemNo] = 0;
 		for(int treeNo = 0; treeNo < tigN; treeNo++)
 		{
-			sinpreds[treeNo][itemNo] = localPredict(roots[treeNo], itemNo, TRAIN);
+			sinpreds[treeNo][itemNo] = (float)localPredict(roots[treeNo], itemNo, TRAIN);
 			jointpreds[itemNo] += sinpreds[treeNo][itemNo];
 		}
 	}
 }
-
-//outputs code for a tree in a grove
-void CGrove::treeCode(int treeNo, fstream& fcode)
-{
-	typedef pair<CTreeNode*, int> nodeLevel; //int corresponds to the level in the tree
-	stack<nodeLevel> outLeft;
-	stack<nodeLevel> outRight; 
-
-	outLeft.push(nodeLevel(&roots[treeNo], 1));
-
-	CTreeNode* pNode;
-	int level;
-	while(!outLeft.empty() || !outRight.empty())
-		if(!outLeft.empty())
-		{
-			pNode = outLeft.top().first;
-			level = outLeft.top().second;
-			outLeft.pop();
-			for(int i = 0; i < level; i++)
-				fcode << "    ";
-			if(!pNode->isLeaf())
-			{
-				outRight.push(nodeLevel(pNode, level));
-				outLeft.push(nodeLevel(pNode->left,level+1));
-				//output the left branch
-				fcode << "if (d[" << pNode->getDivAttr() << "] <= " << pNode->getThresh() << ")\n";
-			}
-			else
-				fcode << "r += " << pNode->getResp() << ";\n";
-		}
-		else // !outRight.empty()
-		{
-			pNode = outRight.top().first;
-			level = outRight.top().second;
-			outRight.pop();
-			outLeft.push(nodeLevel(pNode->right,level+1));
-
-			//output the right branch
-			for(int i = 0; i < level; i++)
-				fcode << "    ";
-			fcode << "else\n";
-		}
-}
\ No newline at end of file
@@ -4,14 +4,21 @@
 
 #pragma once
 #include "TreeNode.h"
+#include "CompiledModel.h"
 
 #ifndef _WIN32
 #include "thread_pool.h"
 #endif
 
+typedef vector<CTreeNode*> CTreeNodepv;
+
 //Grove model: additive ensemble of several trees
 class CGrove
 {
+#ifndef _WIN32
+	friend class CTreeEvalJob;
+#endif
+
 public:
 	//set function for static data pointer
 	static void setData(INDdata& data){pData = &data;}
@@ -20,14 +27,25 @@ public:
 	static void setPool(TThreadPool& pool){pPool = &pool;}
 #endif
 
+	//set function for static convergence criteria
+	static void setConvergence(double tol, int maxRoundsIn, bool oobStopIn)
+		{convTol = tol; maxRounds = maxRoundsIn; oobStop = oobStopIn;}
+
 	//constructor
 	CGrove(double alpha, int tigN);
 
 	//constructor
 	CGrove(double alpha, int tigN, intv& interaction);
 
+	//trains the grove on a standalone bag of data instead of the current bag of the data set
+	void setBag(BagInfo& bag){pBag = &bag;}
+
+	//sets the seed for breaking ties between equally good splits in trees of the grove, 0 by default.
+	//Callers that train the grove set it, so that the constructor does not touch the global random generator
+	void setSeed(unsigned int seedIn){seed = seedIn;}
+
 	//rebuilds grove until convergence with predictions of other grove as starting point
-	ddpair converge(doublevv& sinpreds, doublev& jointpreds);
+	ddpair converge(floatvv& sinpreds, doublev& jointpreds);
 
 	//trains the grove using "layered" version of the algorithm (fixed #trees, increase alpha on every step)
 	void trainLayered();
@@ -35,33 +53,60 @@ public:
 	//saves the grove into the binary file
 	void save(const char* fileName);
 
-	//loads the grove from the binary file
-	void load(fstream& fload);
+	//saves the grove into a binary stream
+	void save(ostream& fsave);
+
+	//loads the grove from a binary stream
+	void load(istream& fload);
 
 	//calculates prediction of the whole grove for a single item
 	double predict(int itemNo, DATA_SET dset);
 
+	//adds the grove to a compiled model as a new group of trees
+	void compile(CCompiledModel& model);
+
 	//returns predictions of single trees and the whole model for all data points in the train set
-	void batchPredict(doublevv& sinpreds, doublev& jointpreds);
+	void batchPredict(floatvv& sinpreds, doublev& jointpreds);
+
+	//returns number of times the grove allocated its train set sized working buffers
+	int getAllocN(){return allocN;}
 
-	//outputs code for a tree in a grove
-	void treeCode(int treeNo, fstream& fcode);
+	//returns number of times a tree in the grove was rebuilt
+	int getRebuildN(){return rebuildN;}
+
+	//returns number of rounds of rebuilding the grove in the last call of converge
+	int getRoundN(){return roundN;}
 
 private:
 	//trains a single tree as part of training a grove
-	void genTreeInGrove(doublev& sinpredsx, doublev& jointpreds, int treeNo);
+	void genTreeInGrove(floatv& sinpredsx, doublev& jointpreds, int treeNo);
 
 	//grows a tree 
 	void growTree(CTreeNode& root);
 
+	//grows several trees in parallel
+	void growTrees(CTreeNodepv& roots);
+
 	//trains several restricted trees, chooses the best
 	void chooseTree(CTreeNode& root, doublev& othpreds);
 
+	//calculates rmse of a single tree on out of bag data
+	double oobPerf(CTreeNode& root, intv& outofbag, doublev& sinoobtar);
+
 	//calculates prediction of a single tree for a single item
 	double localPredict(CTreeNode& root, int itemNo, DATA_SET dset);
 
+	//calculates predictions of a freshly trained tree for items in the bag using their leaf assignments
+	void leafPredict(CTreeNode& root, floatv& sinpredsx, intv& leafMarks);
+
+	//gets out of bag data either from the standalone bag or from the data set
+	int getOutOfBag(intv& oobData, doublev& oobTar);
+
 private:
 	static INDdata* pData;	//data access pointer
+	static double convTol;	//convergence threshold for relative improvement of rmse
+	static int maxRounds;	//max number of rounds of rebuilding in converge, 0 - no limit
+	static bool oobStop;	//stop when rmse on out-of-bag data stalls, even if rmse on the bag improves
 
 #ifndef _WIN32
 	static TThreadPool* pPool;	//thread pool pointer
@@ -71,10 +116,24 @@ private:
 	CTreeNodev roots;		//roots of trees in the grove
 	double alpha;			//one of two key parameters: controls size of tree
 	int tigN;				//one of two key parameters: number of trees in the grove
+	BagInfo* pBag;			//standalone bag of train data, NULL if the current bag of pData is used
 
 	intv interaction;	//a higher-order interaction between all these attributes 
 							//should not be allowed in the model (model is restricted on interaction)
 
+	//working buffers, reused between trees and between calls of converge
+	intv outofbag;		//indexes of out of bag data
+	doublev oobtar;		//targets of out of bag data
+	doublev oobpreds;	//predictions of the grove for out of bag data
+	intv bag;			//indexes of data in the bag
+	doublev bagtar;		//targets of data in the bag
+	doublev bagpreds;	//predictions of the grove for data in the bag
+	intv leafMarks;		//last leaf that contributed to prediction of an item, see leafPredict
+	int allocN;			//number of allocations of working buffers
+	int rebuildN;		//number of tree rebuilds
+	int roundN;			//number of rounds in the last call of converge
+	unsigned int seed;	//seed for breaking ties in trees, every tree rebuild gets a seed derived from it
+
 };
 
 
@@ -93,4 +152,21 @@ struct JobData
 	double b;
 	double H;
 };
+
+//Information required for evaluating a restricted tree on out of bag data. Used for multithreading
+struct EvalJobData
+{
+	EvalJobData(CGrove* in_pGrove, CTreeNode* in_pRoot, intv* in_pOutOfBag, doublev* in_pSinOOBTar, 
+			double* in_pPerf, TCondition* in_pCond, int* in_pToDoN):
+	pGrove(in_pGrove), pRoot(in_pRoot), pOutOfBag(in_pOutOfBag), pSinOOBTar(in_pSinOOBTar), 
+		pPerf(in_pPerf), pCond(in_pCond), pToDoN(in_pToDoN){}
+
+	CGrove* pGrove;
+	CTreeNode* pRoot;
+	intv* pOutOfBag;
+	doublev* pSinOOBTar;
+	double* pPerf;
+	TCondition* pCond;
+	int* pToDoN;
+};
 #endif
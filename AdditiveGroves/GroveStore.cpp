@@ -0,0 +1,213 @@
+// Additive Groves / GroveStore.cpp: implementation of class CGroveStore
+//
+// (c) Daria Sorokina
+
+#include "GroveStore.h"
+#include "functions.h"
+#include "ag_functions.h"
+
+#include <fstream>
+#include <sstream>
+
+//opens the store in the given directory, loads the index if the store exists
+CGroveStore::CGroveStore(string dirName): binSize(0), groveN(0)
+{
+	binFName = dirName + "/groves.bin";
+	idxFName = dirName + "/groves.idx";
+
+	fstream fidx(idxFName.c_str(), ios_base::in);
+	string alphaStr;
+	int tigN;
+	storepos pos;
+	while(fidx >> alphaStr >> tigN >> pos.first >> pos.second)
+	{
+		index[alphaStr + " " + itoa(tigN, 10)].push_back(pos);
+		binSize = pos.first + pos.second;
+		groveN++;
+	}
+}
+
+//deletes all groves from the store
+void CGroveStore::clear()
+{
+	if(fgroves.is_open())
+		fgroves.close();
+	fstream fbin(binFName.c_str(), ios_base::binary | ios_base::out);
+	fstream fidx(idxFName.c_str(), ios_base::out);
+	index.clear();
+	binSize = 0;
+	groveN = 0;
+	buffer.clear();
+	bufferIdx.clear();
+}
+
+//adds a grove saved into a memory buffer as the next bagging iteration of a grid cell
+void CGroveStore::add(double alpha, int tigN, const string& groveBuf)
+{
+	string key = cellKey(alpha, tigN);
+	storepos pos(binSize + (streamoff)buffer.size(), (streamoff)groveBuf.size());
+	index[key].push_back(pos);
+	buffer += groveBuf;
+
+	ostringstream idxLine;
+	idxLine << key << "\t" << pos.first << "\t" << pos.second << "\n";
+	bufferIdx.push_back(idxLine.str());
+}
+
+//writes all added groves to the store with a single write. 
+//The index is written after the groves, so that an interrupted flush does not leave broken entries in it.
+//Groves are written right after the last indexed one, overwriting leftovers of an interrupted flush
+void CGroveStore::flush()
+{
+	if(buffer.empty())
+		return;
+
+	if(fgroves.is_open())
+		fgroves.close();
+	fstream fbin(binFName.c_str(), ios_base::binary | ios_base::in | ios_base::out);
+	if(!fbin.is_open())
+	{
+		fbin.clear();
+		fbin.open(binFName.c_str(), ios_base::binary | ios_base::out);
+	}
+	fbin.seekp(binSize);
+	fbin.write(buffer.data(), (streamsize)buffer.size());
+	fbin.close();
+	if(fbin.fail())
+		throw TREE_WRITE_ERR;
+
+	fstream fidx(idxFName.c_str(), ios_base::out | ios_base::app);
+	for(int lineNo = 0; lineNo < (int)bufferIdx.size(); lineNo++)
+		fidx << bufferIdx[lineNo];
+	fidx.close();
+	if(fidx.fail())
+		throw TREE_WRITE_ERR;
+
+	binSize += (streamoff)buffer.size();
+	groveN += (int)bufferIdx.size();
+	string().swap(buffer);
+	bufferIdx.clear();
+}
+
+//returns the number of bagging iterations saved for a grid cell
+int CGroveStore::getBagN(double alpha, int tigN)
+{
+	map<string, storeposv>::iterator cellIt = index.find(cellKey(alpha, tigN));
+	if(cellIt == index.end())
+		return 0;
+	return (int)cellIt->second.size();
+}
+
+//loads the grove of a given bagging iteration of a grid cell
+void CGroveStore::load(CGrove& grove, double alpha, int tigN, int bagNo)
+{
+	string groveBuf;
+	read(groveBuf, alpha, tigN, bagNo);
+	istringstream fload(groveBuf);
+	grove.load(fload);
+}
+
+//reads raw bytes of the grove of a given bagging iteration of a grid cell
+void CGroveStore::read(string& groveBuf, double alpha, int tigN, int bagNo)
+{
+	if(bagNo >= getBagN(alpha, tigN))
+		throw TEMP_ERR;
+	storepos& pos = index[cellKey(alpha, tigN)][bagNo];
+
+	if(pos.first >= binSize)
+	{//the grove is not written yet
+		groveBuf = buffer.substr((size_t)(pos.first - binSize), (size_t)pos.second);
+		return;
+	}
+
+	if(!fgroves.is_open())
+		fgroves.open(binFName.c_str(), ios_base::binary | ios_base::in);
+	fgroves.clear();
+	fgroves.seekg(pos.first);
+	groveBuf.resize((size_t)pos.second);
+	if(pos.second > 0)
+		fgroves.read(&groveBuf[0], (streamsize)pos.second);
+	if(fgroves.fail())
+		throw TEMP_ERR;
+}
+
+//writes raw bytes of the first bagN groves of a grid cell into a stream, without parsing them.
+//Groves that lie next to each other in the store are copied in blocks of up to 1 Mb
+void CGroveStore::copy(ostream& fout, double alpha, int tigN, int bagN)
+{
+	if(bagN > getBagN(alpha, tigN))
+		throw TEMP_ERR;
+	flush();
+	storeposv& cellPos = index[cellKey(alpha, tigN)];
+
+	if(!fgroves.is_open())
+		fgroves.open(binFName.c_str(), ios_base::binary | ios_base::in);
+	fgroves.clear();
+
+	const streamoff maxBlock = 1 << 20;	//max size of a block
+	string block;
+	for(int bagNo = 0; bagNo < bagN; )
+	{
+		//find the longest run of adjacent groves
+		streamoff start = cellPos[bagNo].first;
+		streamoff size = cellPos[bagNo].second;
+		for(bagNo++; (bagNo < bagN) && (cellPos[bagNo].first == start + size) 
+				&& (size + cellPos[bagNo].second <= maxBlock); bagNo++)
+			size += cellPos[bagNo].second;
+
+		block.resize((size_t)size);
+		fgroves.seekg(start);
+		if(size > 0)
+			fgroves.read(&block[0], (streamsize)size);
+		if(fgroves.fail())
+			throw TEMP_ERR;
+		fout.write(block.data(), (streamsize)size);
+	}
+	if(fout.fail())
+		throw TREE_WRITE_ERR;
+}
+
+//keeps the first groveN groves written to the store and drops the rest: they were written after
+//the checkpoint the training is resumed from. Groves added but not flushed are dropped as well
+void CGroveStore::rollback(int groveN_in)
+{
+	if(fgroves.is_open())
+		fgroves.close();
+	index.clear();
+	binSize = 0;
+	buffer.clear();
+	bufferIdx.clear();
+
+	fstream fidx(idxFName.c_str(), ios_base::in);
+	stringv lines;
+	string line;
+	while(((int)lines.size() < groveN_in) && getline(fidx, line))
+	{
+		istringstream sline(line);
+		string alphaStr;
+		int tigN;
+		storepos pos;
+		if(!(sline >> alphaStr >> tigN >> pos.first >> pos.second))
+			throw TEMP_ERR;
+		index[alphaStr + " " + itoa(tigN, 10)].push_back(pos);
+		binSize = pos.first + pos.second;
+		lines.push_back(line);
+	}
+	fidx.close();
+	if((int)lines.size() < groveN_in)
+		throw TEMP_ERR;
+	groveN = groveN_in;
+
+	fidx.open(idxFName.c_str(), ios_base::out);
+	for(int lineNo = 0; lineNo < groveN; lineNo++)
+		fidx << lines[lineNo] << "\n";
+	fidx.close();
+	if(fidx.fail())
+		throw TREE_WRITE_ERR;
+}
+
+//returns key of a grid cell in the index
+string CGroveStore::cellKey(double alpha, int tigN)
+{
+	return alphaToStr(alpha) + " " + itoa(tigN, 10);
+}
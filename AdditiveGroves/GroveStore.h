@@ -0,0 +1,65 @@
+// Additive Groves / GroveStore.h: interface of class CGroveStore
+//
+// (c) Daria Sorokina
+
+#pragma once
+#include "Grove.h"
+
+#include <map>
+#include <fstream>
+
+//offset and size of a grove in the store
+typedef pair<streamoff, streamoff> storepos;
+typedef vector<storepos> storeposv;
+
+//Indexed store of all groves of the (alpha, N) grid, replaces separate temp files for every grid cell.
+//Groves are appended to a single binary file groves.bin, index file groves.idx lists alpha, N, offset and size 
+//of every grove in the order they were saved. Bagging iterations of a cell go in the same order.
+class CGroveStore
+{
+public:
+	//opens the store in the given directory, loads the index if the store exists
+	CGroveStore(string dirName);
+
+	//deletes all groves from the store
+	void clear();
+
+	//adds a grove saved into a memory buffer (see CGrove::save) as the next bagging iteration of a grid cell.
+	//Groves are kept in memory until flush() is called
+	void add(double alpha, int tigN, const string& groveBuf);
+
+	//writes all added groves to the store with a single write
+	void flush();
+
+	//returns the number of bagging iterations saved for a grid cell
+	int getBagN(double alpha, int tigN);
+
+	//loads the grove of a given bagging iteration of a grid cell
+	void load(CGrove& grove, double alpha, int tigN, int bagNo);
+
+	//reads raw bytes of the grove of a given bagging iteration of a grid cell
+	void read(string& groveBuf, double alpha, int tigN, int bagNo);
+
+	//writes raw bytes of the first bagN groves of a grid cell into a stream, without parsing them
+	void copy(ostream& fout, double alpha, int tigN, int bagN);
+
+	//returns the number of groves written to the store
+	int getGroveN() {return groveN;}
+
+	//keeps the first groveN groves written to the store and drops the rest (used when resuming training)
+	void rollback(int groveN_in);
+
+private:
+	//returns key of a grid cell in the index
+	string cellKey(double alpha, int tigN);
+
+private:
+	string binFName;		//name of the file with the groves
+	string idxFName;		//name of the index file
+	map<string, storeposv> index;	//positions of groves of every grid cell, ordered by bagging iterations
+	streamoff binSize;		//size of the file with the groves
+	int groveN;				//number of groves written to the store
+	string buffer;			//groves added but not written yet
+	stringv bufferIdx;		//index lines for the groves in the buffer
+	fstream fgroves;			//file with the groves open for reading
+};
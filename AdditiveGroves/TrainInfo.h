@@ -15,6 +15,11 @@ public:
 	AG_TRAIN_MODE mode;	//mode of training Groves (fast/slow/layered)
 	bool rms;			//which performance metric is used (rms/roc)
 	int seed;			//random number initializer
+	double convTol;		//grove rebuilding stops when relative improvement of rmse is not larger than this
+	int maxRounds;		//max number of rounds of grove rebuilding, 0 - no limit
+	bool oobStop;		//grove rebuilding also stops when rmse on out-of-bag data stalls
+	bool earlyStop;		//bagging stops as soon as the bagging curve converges
+	int pruneBagN;		//bagging iterations before the first round of grid pruning, 0 - no pruning
 
 	//file names
 	string trainFName;	//train set
@@ -25,5 +30,6 @@ public:
 	intv interaction;	//a higher-order interaction between all these attributes 
 							//should not be allowed in the model (model is restricted on interaction)
 
-	TrainInfo(): minAlpha(0.01), maxTiGN(8), bagN(60), mode(FAST), rms(true), seed(1){};
+	TrainInfo(): minAlpha(0.01), maxTiGN(8), bagN(60), mode(FAST), rms(true), seed(1), 
+		convTol(0.002), maxRounds(0), oobStop(false), earlyStop(false), pruneBagN(0){};
 };
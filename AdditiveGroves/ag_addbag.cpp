@@ -15,51 +15,81 @@
 
 #include <errno.h>
 
-//ag_addbag [-m _model_file_name_] [-b _bagging_iterations_] [-i _init_random_]
+//ag_addbag [-m _model_file_name_] [-b _bagging_iterations_] [-i _init_random_] [-h _threads_]
+//		[-tol _convergence_threshold_] [-rounds _max_rounds_] [-conv bag|oob] [-wd _work_dir_]
+//		[-warm _old_model_file_name_] [-t _train_set_] [-v _validation_set_] [-r _attr_file_] [-c rms|roc]
 int main(int argc, char* argv[])
 {	 
 	try{
-//0. Set log file
+//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
 	LogStream clog;
 	clog << "\n-----\nag_addbag ";
 	for(int argNo = 1; argNo < argc; argNo++)
 		clog << argv[argNo] << " ";
 	clog << "\n\n";
 
-//1a. Set select parameters from AGTemp/params.txt
+//1a. Set select parameters from AGTemp/params.txt. They are not needed when the train set, the validation set 
+//and the attribute file are given in the command line, this is required in warm start mode
 
 	TrainInfo ti;		//current and previous sets of input parameters
-			
-	fstream fparam;	
-	fparam.open("./AGTemp/params.txt", ios_base::in); 
-	string modeStr, metric;
-	double stubD = 0; 
-	int stubI = 0;
-	fparam >> stubI >> ti.trainFName >> ti.validFName >> ti.attrFName >> stubD >> stubI >> stubI 
-		>> modeStr >> metric;	
-
-	//modeStr should be "fast" or "slow" or "layered"	
-	if(modeStr.compare("fast") == 0)
-		ti.mode = FAST;
-	else if(modeStr.compare("slow") == 0)
-		ti.mode = SLOW;
-	else if(modeStr.compare("layered") == 0)
-		ti.mode = LAYERED;
-	else
-		throw TEMP_ERR;
 
-	//metric should be "roc" or "rms"
-	if(metric.compare("rms") == 0)
-		ti.rms = true;
-	else if(metric.compare("roc") == 0)
-		ti.rms = false;
-	else
-		throw TEMP_ERR;
+	//find out which data files are given in the command line, the values are parsed later
+	bool warm = false;	//warm start: the new model is trained from groves of the old one
+	bool hasTrain = false;
+	bool hasValid = false;
+	bool hasAttr = false;
+	for(int argNo = 1; argNo + 1 < argc; argNo += 2)
+	{
+		string flag(argv[argNo]);
+		if(!flag.compare("-warm"))
+			warm = true;
+		else if(!flag.compare("-t"))
+			hasTrain = true;
+		else if(!flag.compare("-v"))
+			hasValid = true;
+		else if(!flag.compare("-r"))
+			hasAttr = true;
+	}
+	bool useParams = !(hasTrain && hasValid && hasAttr);	//whether AGTemp/params.txt is read
+	if(warm && useParams)
+		throw INPUT_ERR;
 
-	fparam.close();
+	if(useParams)
+	{
+		fstream fparam;	
+		fparam.open(workPath("AGTemp/params.txt").c_str(), ios_base::in); 
+		string modeStr, metric;
+		double stubD = 0; 
+		int stubI = 0;
+		fparam >> stubI >> ti.trainFName >> ti.validFName >> ti.attrFName >> stubD >> stubI >> stubI 
+			>> modeStr >> metric;	
+
+		//modeStr should be "fast" or "slow" or "layered"	
+		if(modeStr.compare("fast") == 0)
+			ti.mode = FAST;
+		else if(modeStr.compare("slow") == 0)
+			ti.mode = SLOW;
+		else if(modeStr.compare("layered") == 0)
+			ti.mode = LAYERED;
+		else
+			throw TEMP_ERR;
+
+		//metric should be "roc" or "rms"
+		if(metric.compare("rms") == 0)
+			ti.rms = true;
+		else if(metric.compare("roc") == 0)
+			ti.rms = false;
+		else
+			throw TEMP_ERR;
+
+		readConvParams(fparam, ti);
+		fparam.close();
+	}
 
 //1b. Set default values of parameters
 	string modelFName = "model.bin";	//name of the input file for the model
+	string warmFName;	//name of the model to warm start from, empty - add bagging iterations to modelFName
 	ti.seed = -1;	//random seed default value will be set later	
 #ifndef _WIN32
 	int threadN = 6;	//number of threads
@@ -88,6 +118,38 @@ int main(int argc, char* argv[])
 		}
 		else if(!args[argNo].compare("-i"))
 			ti.seed = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-tol"))
+			ti.convTol = atofExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-rounds"))
+			ti.maxRounds = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-conv"))
+		{
+			if(!args[argNo + 1].compare("bag"))
+				ti.oobStop = false;
+			else if(!args[argNo + 1].compare("oob"))
+				ti.oobStop = true;
+			else
+				throw INPUT_ERR;
+		}
+		else if(!args[argNo].compare("-warm"))
+			warmFName = args[argNo + 1];
+		else if(!args[argNo].compare("-t"))
+			ti.trainFName = args[argNo + 1];
+		else if(!args[argNo].compare("-v"))
+			ti.validFName = args[argNo + 1];
+		else if(!args[argNo].compare("-r"))
+			ti.attrFName = args[argNo + 1];
+		else if(!args[argNo].compare("-c"))
+		{
+			if(!args[argNo + 1].compare("roc"))
+				ti.rms = false;
+			else if(!args[argNo + 1].compare("rms"))
+				ti.rms = true;
+			else
+				throw INPUT_ERR;
+		}
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
 		else if(!args[argNo].compare("-h"))
 #ifndef _WIN32 
 			threadN = atoiExt(argv[argNo + 1]);
@@ -100,6 +162,10 @@ int main(int argc, char* argv[])
 
 	if(ti.seed == -1)
 		ti.seed = ti.bagN;
+	if((ti.convTol < 0) || (ti.maxRounds < 0))
+		throw CONV_ERR;
+	if(warm && !warmFName.compare(modelFName))
+		throw WARM_ERR;
 
 //2.a) Initialize random number generator. 
 	srand(ti.seed);
@@ -109,6 +175,7 @@ int main(int argc, char* argv[])
 				 ti.attrFName.c_str());
 	CGrove::setData(data);
 	CTreeNode::setData(data);
+	CGrove::setConvergence(ti.convTol, ti.maxRounds, ti.oobStop);
 
 //2.c) Start thread pool
 #ifndef _WIN32
@@ -116,9 +183,12 @@ int main(int argc, char* argv[])
 	CGrove::setPool(pool);
 #endif
 
-//3. Read model file
+//3. Read model file. In warm start mode the old model is read, the new one gets the same parameters
 	
-	fstream fmodel(modelFName.c_str(), ios_base::binary | ios_base::in);
+	//groves are read and appended in the format of version 1
+	if(CCompiledModel::isMappable((warm ? warmFName : modelFName).c_str()))
+		throw MODEL_V2_ERR;
+	fstream fmodel((warm ? warmFName : modelFName).c_str(), ios_base::binary | ios_base::in);
 	fmodel.read((char*) &ti.mode, sizeof(enum AG_TRAIN_MODE));
 	
 	//read fast training path
@@ -141,6 +211,7 @@ int main(int argc, char* argv[])
 	fmodel.read((char*) &ti.minAlpha, sizeof(double));
 	if(fmodel.fail())
 		throw MODEL_ERR;
+	int headerSize = (int)fmodel.tellg();	//size of the model parameters in front of the groves
 
 	//Read single groves already in the model, count their number, calculate beginning of bagging curve
 	doublev validTar;
@@ -148,10 +219,13 @@ int main(int argc, char* argv[])
 	doublev rmsV, rocV; 	//bagging curves of rms and roc (if applicable) performance for the validation set
 	doublev predsumsV(validN, 0); 	//sums of predictions for each data point
 	int prevBagN = 0;
+	vector<streampos> warmPos;	//positions of groves in the old model, used in warm start mode
 
 	while(fmodel.peek() != char_traits<char>::eof())
 	{//load next Grove in the ensemble 
 		prevBagN++;
+		if(warm)
+			warmPos.push_back(fmodel.tellg());
 		CGrove grove(ti.minAlpha, ti.maxTiGN);
 		grove.load(fmodel);
 
@@ -165,10 +239,30 @@ int main(int argc, char* argv[])
 		if(!ti.rms)
 			rocV.push_back(roc(predictions, validTar));
 	}
-	fmodel.close();
+	if(prevBagN == 0)
+		throw MODEL_ERR;
+
+	//old model stays open in warm start mode, its groves are loaded again when needed
+	string header;	//model parameters, copied into the new model in warm start mode
+	doublev warmRmsV, warmRocV;	//performance of the old model on the validation set
+	if(warm)
+	{
+		fmodel.clear();
+		fmodel.seekg(0);
+		header.resize(headerSize);
+		fmodel.read(&header[0], headerSize);
+		warmRmsV.swap(rmsV);
+		warmRocV.swap(rocV);
+		predsumsV.assign(validN, 0);
+	}
+	else
+		fmodel.close();
+	int warmBagN = warm ? prevBagN : 0;	//number of bagging iterations in the old model
+	if(warm)
+		prevBagN = 0;
 
 	if(!hasBagN)	//set default value for the number of bagging iterations
-		ti.bagN = prevBagN + 40;
+		ti.bagN = warm ? warmBagN : prevBagN + 40;
 	if(ti.bagN < prevBagN)
 		throw BAGN_ERR;
 
@@ -183,11 +277,28 @@ int main(int argc, char* argv[])
 		clog << "slow mode\n\n";
 	else //if(ti.mode == LAYERED)
 		clog << "layered mode\n\n";
-	clog << "Previous model:\n\t" << prevBagN << " bagging iterations\n";
-	if(ti.rms)
-		clog << "\tRMSE on validation set = " << rmsV[prevBagN - 1] << "\n\n";
+	logConvergence(ti);
+	if(warm)
+	{
+		clog << "Warm start from model " << warmFName << ":\n\t" << warmBagN << " bagging iterations\n";
+		if(ti.rms)
+			clog << "\tRMSE on validation set = " << warmRmsV[warmBagN - 1] << "\n\n";
+		else
+			clog << "\tROC on validation set = " << warmRocV[warmBagN - 1] << "\n\n";
+
+		//the new model starts with parameters of the old one
+		fstream fnew(modelFName.c_str(), ios_base::binary | ios_base::out);
+		fnew.write(header.data(), headerSize);
+		fnew.close();
+	}
 	else
-		clog << "\tROC on validation set = " << rocV[prevBagN - 1] << "\n\n";
+	{
+		clog << "Previous model:\n\t" << prevBagN << " bagging iterations\n";
+		if(ti.rms)
+			clog << "\tRMSE on validation set = " << rmsV[prevBagN - 1] << "\n\n";
+		else
+			clog << "\tROC on validation set = " << rocV[prevBagN - 1] << "\n\n";
+	}
 
 	//4. Train new models
 	int itemN = data.getTrainN();
@@ -199,10 +310,25 @@ int main(int argc, char* argv[])
 		cout << "Iteration " << bagNo + 1 << " out of " << ti.bagN << endl;
 
 		CGrove finGrove(ti.minAlpha, ti.maxTiGN);
-		if(ti.mode == FAST)	//fast training, train only specified path on the grid
+		finGrove.setSeed(rand());
+		if(warm)	//warm start, the final grove starts from a grove of the old model
+		{
+			data.newBag();
+
+			CGrove oldGrove(ti.minAlpha, ti.maxTiGN);
+			fmodel.clear();
+			fmodel.seekg(warmPos[bagNo % warmBagN]);
+			oldGrove.load(fmodel);
+
+			floatvv sinpreds(ti.maxTiGN, floatv(itemN, 0));	
+			doublev jointpreds(itemN, 0);
+			oldGrove.batchPredict(sinpreds, jointpreds);
+			finGrove.converge(sinpreds, jointpreds);
+		}
+		else if(ti.mode == FAST)	//fast training, train only specified path on the grid
 		{
 			//predictions of single trees in a grove on the train set data points
-			doublevv sinpreds(ti.maxTiGN, doublev(itemN, 0));	
+			floatvv sinpreds(ti.maxTiGN, floatv(itemN, 0));	
 			//outer array: grove (multiple trees)
 			//inner array: predictions by a tree in a grove
 
@@ -212,6 +338,7 @@ int main(int argc, char* argv[])
 			int alphaNo = 0;
 			int tigNNo = 0;	
 			CGrove smalltree(0.5, 1);
+			smalltree.setSeed(rand());
 			smalltree.converge(sinpreds, jointpreds);
 			//note: sinpreds, jointpreds are both in-out arguments and are passed
 			//between different groves during training
@@ -234,6 +361,7 @@ int main(int argc, char* argv[])
 				int tigN = tigVal(tigNNo);
 
 				CGrove grove(alpha, tigN);
+				grove.setSeed(rand());
 				grove.converge(sinpreds, jointpreds);
 			}
 			//the last step on the path, automatically place the final model into finGrove
@@ -242,7 +370,7 @@ int main(int argc, char* argv[])
 		else if(ti.mode == SLOW)	//slow training, train the whole grid
 		{
 			//predictions of single trees in groves on the train set data points
-			doublevvv sinpreds(tigNN, doublevv(ti.maxTiGN, doublev(itemN, 0)));	
+			floatvvv sinpreds(tigNN, floatvv(ti.maxTiGN, floatv(itemN, 0)));	
 			//outer array: running column in surface matrix
 			//middle array: grove (multiple trees)
 			//inner array: predictions by a tree in a grove
@@ -269,6 +397,8 @@ int main(int argc, char* argv[])
 					int tigN = tigVal(tigNNo);	//number of trees in the current grove
 					CGrove leftGrove(alpha, tigN); //(alpha, tigN) grove grown from the left neighbor
 					CGrove bottomGrove(alpha, tigN); //(alpha, tigN) grove grown from the bottom neighbor
+					leftGrove.setSeed(rand());
+					bottomGrove.setSeed(rand());
 
 					//note: grove from left is automatically ready for further use,
 					//	but when grove from below is needed instead, it requires extra effort 
@@ -283,7 +413,7 @@ int main(int argc, char* argv[])
 					}
 					else
 					{//build both groves, compare performances on oob data
-						doublevv sinpreds2 = sinpreds[tigNNo - 1];
+						floatvv sinpreds2 = sinpreds[tigNNo - 1];
 						doublev jointpreds2 = jointpreds[tigNNo - 1];
 
 						ddpair rmse_l = leftGrove.converge(sinpreds[tigNNo], jointpreds[tigNNo]);
@@ -317,6 +447,8 @@ int main(int argc, char* argv[])
 		finGrove.save(modelFName.c_str());
 
 	}//end for(int bagNo = prevBagN; bagNo < ti.bagN; bagNo++)
+	if(warm)
+		fmodel.close();
 
 	//5. Output
 	clog << "New model:\n\t" << ti.bagN << " bagging iterations\n";
@@ -327,7 +459,7 @@ int main(int argc, char* argv[])
 
 	//output rms bagging curve in the best (alpha, TiGN) point
 	fstream frmscurve;	//output text file 
-	frmscurve.open("bagging_rms.txt", ios_base::out); 
+	frmscurve.open(workPath("bagging_rms.txt").c_str(), ios_base::out); 
 	for(int bagNo = 0; bagNo < ti.bagN; bagNo++)
 		frmscurve << rmsV[bagNo] << endl;
 	frmscurve.close();
@@ -336,7 +468,7 @@ int main(int argc, char* argv[])
 	if(!ti.rms)
 	{
 		fstream froccurve;	//output text file 
-		froccurve.open("bagging_roc.txt", ios_base::out); 
+		froccurve.open(workPath("bagging_roc.txt").c_str(), ios_base::out); 
 		for(int bagNo = 0; bagNo < ti.bagN; bagNo++)
 			froccurve << rocV[bagNo] << endl;
 		froccurve.close();
@@ -347,7 +479,11 @@ int main(int argc, char* argv[])
 	{
 		int recBagN = ti.bagN + 40;
 		clog << "\nRecommendation: further bagging might produce a better model.\n"
-			<< "Suggested action: addbag -b " << (int)(ti.bagN + 40) << " -m " << modelFName << "\n";
+			<< "Suggested action: addbag -b " << (int)(ti.bagN + 40) << " -m " << modelFName;
+		if(!useParams)	//data files are not in AGTemp/params.txt, they should be given again
+			clog << " -t " << ti.trainFName << " -v " << ti.validFName << " -r " << ti.attrFName 
+				<< " -c " << (ti.rms ? "rms" : "roc");
+		clog << "\n";
 	}
 
 	}catch(TE_ERROR err){
@@ -363,7 +499,18 @@ int main(int argc, char* argv[])
 				break;
 			case INPUT_ERR:
 				errlog << "Usage: ag_addbag [-m _model_file_name_] [-b _bagging_iterations_] "
-					<< "[-i _init_random_]\n";
+					<< "[-i _init_random_] [-h _threads_]\n"
+					<< "\t[-tol _convergence_threshold_] [-rounds _max_rounds_] [-conv bag|oob] [-wd _work_dir_]\n"
+					<< "\t[-warm _old_model_file_name_] [-t _train_set_] [-v _validation_set_] [-r _attr_file_] "
+					<< "[-c rms|roc]\n"
+					<< "Warm start requires the train set, the validation set and the attribute file.\n";
+				break;
+			case WARM_ERR:
+				errlog << "Input error: the new model should be saved into a different file than the old model "
+					<< "used for warm start.\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
 				break;
 			case BAGN_ERR:
 				errlog << "Input error: the number of bagging iterations is less than "
@@ -372,6 +519,12 @@ int main(int argc, char* argv[])
 			case WIN_ERR:
 				errlog << "Input error: TreeExtra currently does not support multithreading for Windows.\n"; 
 				break;
+			case CONV_ERR:
+				errlog << "Input error: convergence threshold or max number of rounds is negative.\n"; 
+				break;
+			case MODEL_V2_ERR:
+				errlog << "Error: model file has format version 2, convert it with ag_convert.\n";
+				break;
 			default:
 				throw err;
 		}
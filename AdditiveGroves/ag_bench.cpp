@@ -0,0 +1,209 @@
+//Additive Groves / ag_bench.cpp: main function of executable ag_bench
+//
+//(c) Daria Sorokina
+
+#include "Grove.h"
+#include "ag_functions.h"
+#include "TrainInfo.h"
+#include "LogStream.h"
+#include "ErrLogStream.h"
+#include "functions.h"
+#include "ag_definitions.h"
+
+#include <errno.h>
+#include <math.h>
+
+//outputs speed and per row latency of one prediction method and the largest difference of its predictions 
+//from the reference ones
+void outSpeed(string name, int rowN, double time, doublev& preds, doublev& refPreds)
+{
+	LogStream clog;
+	double maxDiff = 0;
+	for(int itemNo = 0; itemNo < (int)preds.size(); itemNo++)
+		maxDiff = max(maxDiff, fabs(preds[itemNo] - refPreds[itemNo]));
+	clog << name << ": " << (time > 0 ? rowN / time : 0) << " rows/second, " << time * 1e6 / rowN 
+		<< " microseconds/row, max difference " << maxDiff << "\n";
+}
+
+//ag_bench -p _test_set_ -r _attr_file_ [-m _model_file_name_] [-rep _repetitions_] [-wd _work_dir_]
+int main(int argc, char* argv[])
+{
+	try{
+	//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
+	LogStream clog;
+	clog << "\n-----\nag_bench ";
+	for(int argNo = 1; argNo < argc; argNo++)
+		clog << argv[argNo] << " ";
+	clog << "\n\n";
+
+	//1. Set default values of parameters
+	string modelFName = "model.bin";	//name of the input file for the model
+	int repN = 10;						//number of passes over the test set for every method
+
+	TrainInfo ti;
+
+	//2. Set parameters from command line
+	//check that the number of arguments is even (flags + value pairs)
+	if(argc % 2 == 0)
+		throw INPUT_ERR;
+	//convert input parameters to string from char*
+	stringv args(argc);
+	for(int argNo = 0; argNo < argc; argNo++)
+		args[argNo] = string(argv[argNo]);
+
+	//parse and save input parameters
+	//indicators of presence of required flags in the input
+	bool hasTest = false;
+	bool hasAttr = false;
+
+	for(int argNo = 1; argNo < argc; argNo += 2)
+	{
+		if(!args[argNo].compare("-m"))
+			modelFName = args[argNo + 1];
+		else if(!args[argNo].compare("-p"))
+		{
+			ti.testFName = args[argNo + 1];
+			hasTest = true;
+		}
+		else if(!args[argNo].compare("-r"))
+		{
+			ti.attrFName = args[argNo + 1];
+			hasAttr = true;
+		}
+		else if(!args[argNo].compare("-rep"))
+			repN = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
+		else
+			throw INPUT_ERR;
+	}
+
+	//original trees are needed for comparison, they are kept only in model files of version 1
+	if(!(hasTest && hasAttr) || (repN < 1) || CCompiledModel::isMappable(modelFName.c_str()))
+		throw INPUT_ERR;
+
+//2. Load data
+	INDdata data(ti.trainFName.c_str(), ti.validFName.c_str(), ti.testFName.c_str(),
+				 ti.attrFName.c_str());
+	CGrove::setData(data);
+	CTreeNode::setData(data);
+
+//3. Open model file, read its header
+	fstream fmodel(modelFName.c_str(), ios_base::binary | ios_base::in);
+	fmodel.read((char*) &ti.mode, sizeof(enum AG_TRAIN_MODE));
+	if(ti.mode == FAST)
+	{//skip information about fast training - it is not used in this command
+		int dirN = 0;
+		fmodel.read((char*) &dirN, sizeof(int));
+		bool dirStub = false;
+		for(int dirNo = 0; dirNo < dirN; dirNo++)
+			fmodel.read((char*) &dirStub, sizeof(bool));
+	}
+	fmodel.read((char*) &ti.maxTiGN, sizeof(int));
+	fmodel.read((char*) &ti.minAlpha, sizeof(double));
+	if(fmodel.fail() || (ti.maxTiGN < 1))
+		throw MODEL_ERR;
+
+//4. Load all groves of the model, compile them
+	vector<CGrove*> groves;
+	CCompiledModel model;
+	while(fmodel.peek() != char_traits<char>::eof())
+	{
+		groves.push_back(new CGrove(ti.minAlpha, ti.maxTiGN));
+		groves.back()->load(fmodel);
+		groves.back()->compile(model);
+	}
+	ti.bagN = (int)groves.size();
+	if(ti.bagN == 0)
+		throw MODEL_ERR;
+
+	doublev testTar;
+	int testN = data.getTargets(testTar, TEST);
+	vector<const float*> rows(testN);
+	for(int itemNo = 0; itemNo < testN; itemNo++)
+		rows[itemNo] = data.getRow(itemNo, TEST);
+	int rowN = testN * repN;	//number of predictions made by every method
+	clog << ti.bagN << " groves, " << model.getNodeN() << " nodes, " << testN << " test cases, "
+		<< repN << " repetitions\n\n";
+
+//5. Measure speed of prediction methods
+	//original trees, one case at a time
+	doublev refPreds(testN, 0);
+	double startTime = getTime();
+	for(int repNo = 0; repNo < repN; repNo++)
+	{
+		refPreds.assign(testN, 0);
+		for(int bagNo = 0; bagNo < ti.bagN; bagNo++)
+			for(int itemNo = 0; itemNo < testN; itemNo++)
+				refPreds[itemNo] += groves[bagNo]->predict(itemNo, TEST);
+	}
+	outSpeed("Original trees", rowN, getTime() - startTime, refPreds, refPreds);
+
+	//compiled model, one case at a time
+	doublev preds(testN, 0);
+	startTime = getTime();
+	for(int repNo = 0; repNo < repN; repNo++)
+		for(int itemNo = 0; itemNo < testN; itemNo++)
+			preds[itemNo] = model.predict(rows[itemNo]);
+	outSpeed("Compiled model, single rows", rowN, getTime() - startTime, preds, refPreds);
+
+	//compiled model, blocks of cases
+	startTime = getTime();
+	for(int repNo = 0; repNo < repN; repNo++)
+		model.predictBatch(rows, preds);
+	outSpeed("Compiled model, blocks of " + itoa(BATCH_ROWN, 10) + " rows", rowN, getTime() - startTime,
+		preds, refPreds);
+
+	//compacted model: a single group, redundant splits, constant and duplicate trees are merged
+	CCompiledModel compacted;
+	compacted.compact(model, 1.0);
+	startTime = getTime();
+	for(int repNo = 0; repNo < repN; repNo++)
+		compacted.predictBatch(rows, preds);
+	outSpeed("Compacted model (" + itoa(compacted.getTreeN(), 10) + " of " + itoa(model.getTreeN(), 10) 
+		+ " trees), blocks of " + itoa(BATCH_ROWN, 10) + " rows", rowN, getTime() - startTime, preds, refPreds);
+
+	//compiled model, QuickScorer
+	model.useQuickScorer();
+	startTime = getTime();
+	for(int repNo = 0; repNo < repN; repNo++)
+		model.predictBatch(rows, preds);
+	outSpeed("Compiled model, QuickScorer (" + itoa(model.getQSTreeN(), 10) + " trees)", rowN, 
+		getTime() - startTime, preds, refPreds);
+
+	for(int bagNo = 0; bagNo < ti.bagN; bagNo++)
+		delete groves[bagNo];
+
+	}catch(TE_ERROR err){
+		te_errMsg((TE_ERROR)err);
+		return 1;
+	}catch(AG_ERROR err){
+		ErrLogStream errlog;
+		switch(err)
+		{
+			case INPUT_ERR:
+				errlog << "Usage: ag_bench -p _test_set_ -r _attr_file_name_ "
+					<< "[-m _model_file_name_] [-rep _repetitions_] [-wd _work_dir_]\n"
+					<< "The model file should have format version 1.\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
+				break;
+			default:
+				throw err;
+		}
+		return 1;
+	}catch(exception &e){
+		ErrLogStream errlog;
+		string errstr(e.what());
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}catch(...){
+		string errstr = strerror(errno);
+		ErrLogStream errlog;
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+//Additive Groves / ag_codegen.cpp: main function of executable ag_codegen
+//
+//(c) Daria Sorokina
+
+#include "Grove.h"
+#include "ag_functions.h"
+#include "TrainInfo.h"
+#include "LogStream.h"
+#include "ErrLogStream.h"
+#include "functions.h"
+#include "ag_definitions.h"
+
+#include <errno.h>
+
+//ag_codegen -r _attr_file_ [-m _model_file_name_] [-o _output_file_name_] [-f _function_name_] [-wd _work_dir_]
+int main(int argc, char* argv[])
+{
+	try{
+	//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
+	LogStream clog;
+	clog << "\n-----\nag_codegen ";
+	for(int argNo = 1; argNo < argc; argNo++)
+		clog << argv[argNo] << " ";
+	clog << "\n\n";
+
+	//1. Set default values of parameters
+	string modelFName = "model.bin";	//name of the input file for the model
+	string codeFName = "model.cpp";		//name of the output file for the source code
+	string funcName = "agPredict";		//name of the prediction function
+
+	TrainInfo ti;
+
+	//2. Set parameters from command line
+	//check that the number of arguments is even (flags + value pairs)
+	if(argc % 2 == 0)
+		throw INPUT_ERR;
+	//convert input parameters to string from char*
+	stringv args(argc);
+	for(int argNo = 0; argNo < argc; argNo++)
+		args[argNo] = string(argv[argNo]);
+
+	//parse and save input parameters
+	//indicators of presence of required flags in the input
+	bool hasAttr = false;
+
+	for(int argNo = 1; argNo < argc; argNo += 2)
+	{
+		if(!args[argNo].compare("-r"))
+		{
+			ti.attrFName = args[argNo + 1];
+			hasAttr = true;
+		}
+		else if(!args[argNo].compare("-m"))
+			modelFName = args[argNo + 1];
+		else if(!args[argNo].compare("-o"))
+			codeFName = args[argNo + 1];
+		else if(!args[argNo].compare("-f"))
+			funcName = args[argNo + 1];
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
+		else
+			throw INPUT_ERR;
+	}
+
+	//the function name should be a valid C++ identifier
+	if(!hasAttr || funcName.empty() || isdigit(funcName[0])
+		|| (funcName.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_")
+			!= string::npos))
+		throw INPUT_ERR;
+
+//2. Load attribute file
+	INDdata data(ti.trainFName.c_str(), ti.validFName.c_str(), ti.testFName.c_str(), ti.attrFName.c_str());
+	CGrove::setData(data);
+	CTreeNode::setData(data);
+	stringv attrNames(data.getAttrN());
+	for(int attrNo = 0; attrNo < data.getAttrN(); attrNo++)
+		attrNames[attrNo] = data.getAttrName(attrNo);
+
+//3. Load all groves of the model
+	CCompiledModel model;	//all groves of the model in flat arrays
+	ti.bagN = loadModel(modelFName, data, ti, model);
+
+//4. Output the source code, averaging over bagging iterations is folded into leaf values
+	fstream fcode(codeFName.c_str(), ios_base::out);
+	model.genCode(fcode, funcName, 1.0 / ti.bagN, attrNames);
+	fcode.close();
+	if(fcode.fail())
+		throw TREE_WRITE_ERR;
+
+	clog << "Function " << funcName << " for " << ti.bagN << " groves, " << model.getNodeN()
+		<< " nodes is saved into " << codeFName << "\n";
+
+	}catch(TE_ERROR err){
+		te_errMsg((TE_ERROR)err);
+		return 1;
+	}catch(AG_ERROR err){
+		ErrLogStream errlog;
+		switch(err)
+		{
+			case INPUT_ERR:
+				errlog << "Usage: ag_codegen -r _attr_file_name_ [-m _model_file_name_] [-o _output_file_name_] "
+					<< "[-f _function_name_]\n\t[-wd _work_dir_]\n"
+					<< "The function name should be a valid C++ identifier.\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
+				break;
+			default:
+				throw err;
+		}
+		return 1;
+	}catch(exception &e){
+		ErrLogStream errlog;
+		string errstr(e.what());
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}catch(...){
+		string errstr = strerror(errno);
+		ErrLogStream errlog;
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+//Additive Groves / ag_compact.cpp: main function of executable ag_compact
+//
+//(c) Daria Sorokina
+
+#include "Grove.h"
+#include "ag_functions.h"
+#include "TrainInfo.h"
+#include "LogStream.h"
+#include "ErrLogStream.h"
+#include "functions.h"
+#include "ag_definitions.h"
+
+#include <errno.h>
+
+//ag_compact -r _attr_file_ -o _output_file_name_ [-m _model_file_name_] [-wd _work_dir_]
+int main(int argc, char* argv[])
+{
+	try{
+	//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
+	LogStream clog;
+	clog << "\n-----\nag_compact ";
+	for(int argNo = 1; argNo < argc; argNo++)
+		clog << argv[argNo] << " ";
+	clog << "\n\n";
+
+	//1. Set default values of parameters
+	string modelFName = "model.bin";	//name of the input file for the model
+	string outFName;					//name of the output file for the compacted model
+
+	TrainInfo ti;
+
+	//2. Set parameters from command line
+	//check that the number of arguments is even (flags + value pairs)
+	if(argc % 2 == 0)
+		throw INPUT_ERR;
+	//convert input parameters to string from char*
+	stringv args(argc);
+	for(int argNo = 0; argNo < argc; argNo++)
+		args[argNo] = string(argv[argNo]);
+
+	//parse and save input parameters
+	//indicators of presence of required flags in the input
+	bool hasAttr = false;
+
+	for(int argNo = 1; argNo < argc; argNo += 2)
+	{
+		if(!args[argNo].compare("-r"))
+		{
+			ti.attrFName = args[argNo + 1];
+			hasAttr = true;
+		}
+		else if(!args[argNo].compare("-m"))
+			modelFName = args[argNo + 1];
+		else if(!args[argNo].compare("-o"))
+			outFName = args[argNo + 1];
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
+		else
+			throw INPUT_ERR;
+	}
+
+	if(!hasAttr || outFName.empty() || !outFName.compare(modelFName))
+		throw INPUT_ERR;
+
+//2. Load attribute file
+	INDdata data(ti.trainFName.c_str(), ti.validFName.c_str(), ti.testFName.c_str(), ti.attrFName.c_str());
+	CGrove::setData(data);
+	CTreeNode::setData(data);
+
+//3. Load the model
+	CCompiledModel model;	//all groves of the model in flat arrays
+	ti.bagN = loadModel(modelFName, data, ti, model);
+
+//4. Merge all groves into one group of trees, averaging over bagging iterations is folded into leaf values
+	CCompiledModel compacted;
+	compacted.compact(model, 1.0 / ti.bagN);
+
+//5. Save the compacted model into a file of version 2, it has a single bagging iteration
+	fstream fout(outFName.c_str(), ios_base::binary | ios_base::out);
+	ModelFileHeader header;
+	header.attrHash = data.getAttrHash();
+	header.mode = ti.mode;
+	header.maxTiGN = ti.maxTiGN;
+	header.minAlpha = ti.minAlpha;
+	boolv dirs;
+	compacted.save(fout, header, dirs);
+	fout.close();
+	if(fout.fail())
+		throw TREE_WRITE_ERR;
+
+	clog << "Model with " << ti.bagN << " groves, " << model.getTreeN() << " trees, " << model.getNodeN()
+		<< " nodes is compacted into " << compacted.getTreeN() << " trees, " << compacted.getNodeN()
+		<< " nodes and saved into " << outFName << "\n";
+
+	}catch(TE_ERROR err){
+		te_errMsg((TE_ERROR)err);
+		return 1;
+	}catch(AG_ERROR err){
+		ErrLogStream errlog;
+		switch(err)
+		{
+			case INPUT_ERR:
+				errlog << "Usage: ag_compact -r _attr_file_name_ -o _output_file_name_ [-m _model_file_name_] "
+					<< "[-wd _work_dir_]\n"
+					<< "The output file name should be different from the model file name.\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
+				break;
+			default:
+				throw err;
+		}
+		return 1;
+	}catch(exception &e){
+		ErrLogStream errlog;
+		string errstr(e.what());
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}catch(...){
+		string errstr = strerror(errno);
+		ErrLogStream errlog;
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}
+	return 0;
+}
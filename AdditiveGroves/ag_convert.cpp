@@ -0,0 +1,137 @@
+//Additive Groves / ag_convert.cpp: main function of executable ag_convert
+//
+//(c) Daria Sorokina
+
+#include "Grove.h"
+#include "ag_functions.h"
+#include "TrainInfo.h"
+#include "LogStream.h"
+#include "ErrLogStream.h"
+#include "functions.h"
+#include "ag_definitions.h"
+
+#include <errno.h>
+
+//ag_convert -r _attr_file_ -o _output_file_name_ [-m _model_file_name_] [-wd _work_dir_]
+int main(int argc, char* argv[])
+{
+	try{
+	//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
+	LogStream clog;
+	clog << "\n-----\nag_convert ";
+	for(int argNo = 1; argNo < argc; argNo++)
+		clog << argv[argNo] << " ";
+	clog << "\n\n";
+
+	//1. Set default values of parameters
+	string modelFName = "model.bin";	//name of the input file for the model
+	string outFName;					//name of the output file for the converted model
+
+	TrainInfo ti;
+
+	//2. Set parameters from command line
+	//check that the number of arguments is even (flags + value pairs)
+	if(argc % 2 == 0)
+		throw INPUT_ERR;
+	//convert input parameters to string from char*
+	stringv args(argc);
+	for(int argNo = 0; argNo < argc; argNo++)
+		args[argNo] = string(argv[argNo]);
+
+	//parse and save input parameters
+	//indicators of presence of required flags in the input
+	bool hasAttr = false;
+
+	for(int argNo = 1; argNo < argc; argNo += 2)
+	{
+		if(!args[argNo].compare("-r"))
+		{
+			ti.attrFName = args[argNo + 1];
+			hasAttr = true;
+		}
+		else if(!args[argNo].compare("-m"))
+			modelFName = args[argNo + 1];
+		else if(!args[argNo].compare("-o"))
+			outFName = args[argNo + 1];
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
+		else
+			throw INPUT_ERR;
+	}
+
+	if(!hasAttr || outFName.empty() || !outFName.compare(modelFName))
+		throw INPUT_ERR;
+
+//2. Load attribute file
+	INDdata data(ti.trainFName.c_str(), ti.validFName.c_str(), ti.testFName.c_str(), ti.attrFName.c_str());
+	CGrove::setData(data);
+	CTreeNode::setData(data);
+
+//3. Load the model
+	CCompiledModel model;	//all groves of the model in flat arrays
+	boolv dirs;				//directions on the training grid, fast mode only
+	bool toV2 = !CCompiledModel::isMappable(modelFName.c_str());
+	ti.bagN = loadModel(modelFName, data, ti, model, &dirs);
+	//groves of a compacted model are merged, a file of version 1 can not hold them
+	if(!toV2 && (model.getTreeN() != ti.bagN * ti.maxTiGN))
+		throw COMPACT_ERR;
+
+//4. Save the model in the other format
+	fstream fout(outFName.c_str(), ios_base::binary | ios_base::out);
+	if(toV2)
+	{
+		ModelFileHeader header;
+		header.attrHash = data.getAttrHash();
+		header.mode = ti.mode;
+		header.maxTiGN = ti.maxTiGN;
+		header.minAlpha = ti.minAlpha;
+		model.save(fout, header, dirs);
+	}
+	else
+	{
+		writeModelHeader(fout, ti, dirs);
+		model.saveTrees(fout);
+	}
+	fout.close();
+	if(fout.fail())
+		throw TREE_WRITE_ERR;
+
+	clog << "Model with " << ti.bagN << " groves, " << model.getNodeN() << " nodes is converted from version "
+		<< (toV2 ? 1 : 2) << " to version " << (toV2 ? 2 : 1) << " and saved into " << outFName << "\n";
+
+	}catch(TE_ERROR err){
+		te_errMsg((TE_ERROR)err);
+		return 1;
+	}catch(AG_ERROR err){
+		ErrLogStream errlog;
+		switch(err)
+		{
+			case INPUT_ERR:
+				errlog << "Usage: ag_convert -r _attr_file_name_ -o _output_file_name_ [-m _model_file_name_] "
+					<< "[-wd _work_dir_]\n"
+					<< "The output file name should be different from the model file name.\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
+				break;
+			case COMPACT_ERR:
+				errlog << "Error: a compacted model can not be converted to version 1.\n";
+				break;
+			default:
+				throw err;
+		}
+		return 1;
+	}catch(exception &e){
+		ErrLogStream errlog;
+		string errstr(e.what());
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}catch(...){
+		string errstr = strerror(errno);
+		ErrLogStream errlog;
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -17,6 +17,16 @@ enum AG_ERROR
 	DIR_ERR = 108,
 	MERGE_MISMATCH_ERR = 109,
 	SAME_SEED_ERR = 110,
-	TRAIN_EQ_VALID_ERR = 111
+	TRAIN_EQ_VALID_ERR = 111,
+	CONV_ERR = 112,
+	PRUNE_ERR = 113,
+	WORKDIR_ERR = 114,
+	RESUME_ERR = 115,
+	WARM_ERR = 116,
+	WORKERN_ERR = 117,
+	WORKER_ERR = 118,
+	SOCKET_ERR = 119,
+	COMPACT_ERR = 120,
+	MODEL_V2_ERR = 121
 };
 
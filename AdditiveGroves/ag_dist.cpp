@@ -0,0 +1,306 @@
+//Additive Groves / ag_dist.cpp: main function of executable ag_dist
+//
+//(c) Daria Sorokina
+
+#include "LogStream.h"
+#include "ErrLogStream.h"
+#include "functions.h"
+#include "ag_definitions.h"
+#include "ag_functions.h"
+#include "GridMerge.h"
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+
+//A worker process: ag_train run on a part of bagging iterations in its own working directory
+struct WorkerInfo
+{
+	string dirName;	//working directory of the worker
+	int bagN;		//number of bagging iterations
+	int seed;		//random seed, different for all workers
+	int attemptN;	//number of times the worker was started
+	int pid;		//id of the running process, 0 if the worker is not running
+};
+
+#ifndef _WIN32
+//starts ag_train for the worker in a child process. Output of ag_train goes to output.txt in the worker directory.
+//A restarted worker resumes from its last checkpoint, if there is one
+void startWorker(WorkerInfo& wi, stringv& trainArgs, string trainPath)
+{
+	stringv args(1, trainPath);
+	args.insert(args.end(), trainArgs.begin(), trainArgs.end());
+	args.push_back("-b");
+	args.push_back(itoa(wi.bagN, 10));
+	args.push_back("-i");
+	args.push_back(itoa(wi.seed, 10));
+	args.push_back("-wd");
+	args.push_back(wi.dirName);
+	struct stat status;
+	if((wi.attemptN > 0) && (stat((wi.dirName + "/AGTemp/checkpoint.bin").c_str(), &status) == 0))
+	{
+		args.push_back("-resume");
+		args.push_back("on");
+	}
+	wi.attemptN++;
+
+	vector<char*> argv(args.size() + 1, NULL);
+	for(int argNo = 0; argNo < (int)args.size(); argNo++)
+		argv[argNo] = &args[argNo][0];
+
+	mkdir(wi.dirName.c_str(), 0777);
+	string outFName = wi.dirName + "/output.txt";
+	cout.flush();
+
+	pid_t pid = fork();
+	if(pid < 0)
+		throw WORKER_ERR;
+	if(pid == 0)
+	{//child process: redirect output and replace the process with ag_train
+		int fd = open(outFName.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+		if(fd >= 0)
+		{
+			dup2(fd, 1);
+			dup2(fd, 2);
+			close(fd);
+		}
+		execvp(argv[0], &argv[0]);
+		_exit(127);
+	}
+	wi.pid = (int)pid;
+}
+#endif
+
+//ag_dist -t _train_set_ -v _validation_set_ -r _attr_file_ [-k _workers_] [-b _bagging_iterations_]
+//		[-i _init_random_] [-retry _max_retries_] [-h _threads_per_worker_] [-wd _work_dir_]
+//		[-a _alpha_value_] [-n _N_value_] [-s slow|fast|layered] [-c rms|roc]
+//		[-tol _convergence_threshold_] [-rounds _max_rounds_] [-conv bag|oob] [-stop on|off]
+int main(int argc, char* argv[])
+{
+	try{
+//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv), true);
+	LogStream clog;
+	LogStream::init(true);
+	clog << "\n-----\nag_dist ";
+	for(int argNo = 1; argNo < argc; argNo++)
+		clog << argv[argNo] << " ";
+	clog << "\n\n";
+
+//1. Set input parameters from command line
+
+	//check that the number of arguments is even (flags + value pairs)
+	if(argc % 2 == 0)
+		throw INPUT_ERR;
+	//convert input parameters to string from char*
+	stringv args(argc);
+	for(int argNo = 0; argNo < argc; argNo++)
+		args[argNo] = string(argv[argNo]);
+
+	int workerN = 0;	//number of workers, 0 - one worker per threadN processors
+	int bagN = 60;		//overall number of bagging iterations
+	int seed = 1;		//random seed of the first worker, other workers get the following values
+	int retryN = 2;		//max number of times a failed worker is restarted
+	int threadN = 6;	//number of threads in each worker
+	stringv trainArgs;	//arguments passed to all workers as they are
+
+	//parse and save input parameters
+	//indicators of presence of required flags in the input
+	bool hasTrain = false;
+	bool hasVal = false;
+	bool hasAttr = false;
+
+	for(int argNo = 1; argNo < argc; argNo += 2)
+	{
+		if(!args[argNo].compare("-k"))
+			workerN = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-b"))
+			bagN = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-i"))
+			seed = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-retry"))
+			retryN = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-h"))
+			threadN = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
+		else if(!args[argNo].compare("-t") || !args[argNo].compare("-v") || !args[argNo].compare("-r")
+			|| !args[argNo].compare("-a") || !args[argNo].compare("-n") || !args[argNo].compare("-s")
+			|| !args[argNo].compare("-c") || !args[argNo].compare("-tol") || !args[argNo].compare("-rounds")
+			|| !args[argNo].compare("-conv") || !args[argNo].compare("-stop"))
+		{//parameters of training are checked by workers
+			hasTrain = hasTrain || !args[argNo].compare("-t");
+			hasVal = hasVal || !args[argNo].compare("-v");
+			hasAttr = hasAttr || !args[argNo].compare("-r");
+			trainArgs.push_back(args[argNo]);
+			trainArgs.push_back(args[argNo + 1]);
+		}
+		else
+			throw INPUT_ERR;
+	}
+
+	if(!(hasTrain && hasVal && hasAttr))
+		throw INPUT_ERR;
+
+#ifdef _WIN32
+	throw WIN_ERR;
+#else
+	if(workerN == 0)
+		workerN = max(2, (int)sysconf(_SC_NPROCESSORS_ONLN) / max(threadN, 1));
+	if((workerN < 2) || (bagN < workerN) || (retryN < 0))
+		throw WORKERN_ERR;
+	trainArgs.push_back("-h");
+	trainArgs.push_back(itoa(threadN, 10));
+
+	//ag_train is taken from the same directory as ag_dist, or from PATH if ag_dist was started from PATH
+	string trainPath = "ag_train";
+	string selfPath = argv[0];
+	if(selfPath.rfind('/') != string::npos)
+		trainPath = selfPath.substr(0, selfPath.rfind('/') + 1) + trainPath;
+
+//2. Start workers: bagging iterations are split evenly between them, every worker gets its own seed
+	vector<WorkerInfo> workers(workerN);
+	for(int workerNo = 0; workerNo < workerN; workerNo++)
+	{
+		WorkerInfo& wi = workers[workerNo];
+		wi.dirName = workPath("worker" + itoa(workerNo + 1, 10));
+		wi.bagN = bagN / workerN + ((workerNo < bagN % workerN) ? 1 : 0);
+		wi.seed = seed + workerNo;
+		wi.attemptN = 0;
+		wi.pid = 0;
+		clog << "Worker " << workerNo + 1 << ": " << wi.bagN << " bagging iterations, seed " << wi.seed
+			<< ", directory " << wi.dirName << "\n";
+		startWorker(wi, trainArgs, trainPath);
+	}
+	clog << "\n";
+
+//3. Wait for workers to finish, restart failed ones
+	int runN = workerN;	//number of running workers
+	while(runN > 0)
+	{
+		int status = 0;
+		pid_t pid = waitpid(-1, &status, 0);
+		if(pid < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			throw WORKER_ERR;
+		}
+
+		int workerNo = 0;
+		while((workerNo < workerN) && (workers[workerNo].pid != (int)pid))
+			workerNo++;
+		if(workerNo == workerN)
+			continue;
+		WorkerInfo& wi = workers[workerNo];
+		wi.pid = 0;
+
+		if(WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+		{
+			runN--;
+			clog << "Worker " << workerNo + 1 << " finished, " << workerN - runN << " out of "
+				<< workerN << " workers are done\n";
+			continue;
+		}
+
+		if(WIFEXITED(status))
+			clog << "Worker " << workerNo + 1 << " failed with exit code " << WEXITSTATUS(status);
+		else
+			clog << "Worker " << workerNo + 1 << " was terminated by signal " << WTERMSIG(status);
+
+		if(wi.attemptN <= retryN)
+		{
+			clog << ", restarting it\n";
+			startWorker(wi, trainArgs, trainPath);
+		}
+		else
+		{//stop the rest of workers
+			clog << ", giving up\n";
+			for(int otherNo = 0; otherNo < workerN; otherNo++)
+				if(workers[otherNo].pid != 0)
+				{
+					kill((pid_t)workers[otherNo].pid, SIGTERM);
+					waitpid((pid_t)workers[otherNo].pid, &status, 0);
+				}
+			clog << "See " << wi.dirName << "/output.txt for details.\n";
+			throw WORKER_ERR;
+		}
+	}
+	clog << "\n";
+
+//4. Merge grids of all workers in the working directory
+	stringv folders(workerN);
+	for(int workerNo = 0; workerNo < workerN; workerNo++)
+		folders[workerNo] = workers[workerNo].dirName;
+	mergeGrids(folders);
+#endif
+
+	}catch(TE_ERROR err){
+		ErrLogStream errlog;
+		switch(err)
+		{
+			case TREE_LOAD_ERR:
+				errlog << "Error: temporary files of workers are corrupted.\n";
+				break;
+			default:
+				te_errMsg((TE_ERROR)err);
+		}
+		return 1;
+
+	}catch(AG_ERROR err){
+		ErrLogStream errlog;
+		switch(err)
+		{
+			case INPUT_ERR:
+				errlog << "Usage: ag_dist -t _train_set_ -v _validation_set_ -r _attr_file_ [-k _workers_] "
+					<< "[-b _bagging_iterations_]\n\t[-i _init_random_] [-retry _max_retries_] "
+					<< "[-h _threads_per_worker_] [-wd _work_dir_]\n"
+					<< "\t[-a _alpha_value_] [-n _N_value_] [-s slow|fast|layered] [-c rms|roc]\n"
+					<< "\t[-tol _convergence_threshold_] [-rounds _max_rounds_] [-conv bag|oob] [-stop on|off]\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory cannot be created.\n";
+				break;
+			case WIN_ERR:
+				errlog << "Input error: ag_dist currently does not support Windows.\n";
+				break;
+			case WORKERN_ERR:
+				errlog << "Input error: there should be at least two workers, at least one bagging iteration "
+					<< "per worker and a non-negative number of retries.\n";
+				break;
+			case WORKER_ERR:
+				errlog << "Error: a worker process could not be started or failed too many times.\n";
+				break;
+			case TEMP_ERR:
+				errlog << "Error: temporary files of workers are missing or corrupted.\n";
+				break;
+			case DIR_ERR:
+				errlog << "Error: one of worker directories does not exist.\n";
+				break;
+			case MERGE_MISMATCH_ERR:
+				errlog << "Error: model parameters in worker directories do not match.\n";
+				break;
+			default:
+				throw err;
+		}
+		return 1;
+	}catch(exception &e){
+		ErrLogStream errlog;
+		string errstr(e.what());
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}catch(...){
+		string errstr = strerror(errno);
+		ErrLogStream errlog;
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}
+	return 0;
+}
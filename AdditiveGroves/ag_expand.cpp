@@ -3,6 +3,7 @@
 //(c) Daria Sorokina
 
 #include "Grove.h"
+#include "GroveStore.h"
 #include "ag_functions.h"
 #include "functions.h"
 #include "LogStream.h"
@@ -13,14 +14,17 @@
 #include "thread_pool.h"
 #endif
 
+#include <sstream>
 #include <errno.h>
 
 //ag_expand [-a _alpha_value_] [-n _N_value_] [-b _bagging_iterations_] [-i _init_random_] [-e on/off]
+//		[-h _threads_] [-tol _convergence_threshold_] [-rounds _max_rounds_] [-conv bag|oob]
 
 int main(int argc, char* argv[])
 {	
 	try{
-//0. Set log file
+//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
 	LogStream clog;
 	clog << "\n-----\nag_expand ";
 	for(int argNo = 1; argNo < argc; argNo++)
@@ -37,7 +41,7 @@ int main(int argc, char* argv[])
 	double prevBest;		//best value of performance achieved on the previous run
 			
 	fstream fparam;	
-	fparam.open("./AGTemp/params.txt", ios_base::in); 
+	fparam.open(workPath("AGTemp/params.txt").c_str(), ios_base::in); 
 	string modeStr, metric;
 	fparam >> ti.seed >> ti.trainFName >> ti.validFName >> ti.attrFName >> ti.minAlpha >> ti.maxTiGN 
 		>> ti.bagN >> modeStr >> metric;	
@@ -62,11 +66,16 @@ int main(int argc, char* argv[])
 
 	if(fparam.fail())
 		throw TEMP_ERR;
+	readConvParams(fparam, ti);
 	fparam.close();
 
+	//groves in pruned cells are incomplete, such grid cannot be continued
+	if(isPruned(workPath("")))
+		throw PRUNE_ERR;
+
 	//read best value of performance on previous run
 	fstream fbest;
-	fbest.open("./AGTemp/best.txt", ios_base::in); 
+	fbest.open(workPath("AGTemp/best.txt").c_str(), ios_base::in); 
 	fbest >> prevBest;
 	if(fbest.fail())
 		throw TEMP_ERR;
@@ -100,6 +109,21 @@ int main(int argc, char* argv[])
 			ti.bagN = atoiExt(argv[argNo + 1]);
 		else if(!args[argNo].compare("-i"))
 			ti.seed = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-tol"))
+			ti.convTol = atofExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-rounds"))
+			ti.maxRounds = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-conv"))
+		{
+			if(!args[argNo + 1].compare("bag"))
+				ti.oobStop = false;
+			else if(!args[argNo + 1].compare("oob"))
+				ti.oobStop = true;
+			else
+				throw INPUT_ERR;
+		}
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
 		else if(!args[argNo].compare("-h"))
 #ifndef _WIN32 
 			threadN = atoiExt(argv[argNo + 1]);
@@ -131,6 +155,8 @@ int main(int argc, char* argv[])
 	}
 	if(ti.bagN < prev.bagN)
 		throw BAGN_ERR;
+	if((ti.convTol < 0) || (ti.maxRounds < 0))
+		throw CONV_ERR;
 
 //2.a) Initialize random number generator. 
 	srand(ti.seed);
@@ -140,6 +166,7 @@ int main(int argc, char* argv[])
 				 ti.attrFName.c_str());
 	CGrove::setData(data);
 	CTreeNode::setData(data);
+	CGrove::setConvergence(ti.convTol, ti.maxRounds, ti.oobStop);
 
 //3.a) Start thread pool
 #ifndef _WIN32
@@ -179,6 +206,7 @@ int main(int argc, char* argv[])
 		clog << "slow mode\n\n";
 	else //if(ti.mode == LAYERED)
 		clog << "layered mode\n\n";
+	logConvergence(ti);
 	cout << "Model already trained:\n\tAlpha = " << prev.minAlpha << "\n\tN = " << prev.maxTiGN 
 		<< "\n\t" << prev.bagN << " bagging iterations\n"; 
 	if(ti.rms)
@@ -209,7 +237,7 @@ int main(int argc, char* argv[])
 	
 	//load part of predsumsV that is already filled
 	fstream fsums;
-	fsums.open("./AGTemp/predsums.bin", ios_base::binary | ios_base::in);
+	fsums.open(workPath("AGTemp/predsums.bin").c_str(), ios_base::binary | ios_base::in);
 	for(int tigNNo = 0; tigNNo < prevTiGNN; tigNNo++)
 		for(int alphaNo = 0; alphaNo < prevAlphaN; alphaNo++)
 			fsums >> predsumsV[tigNNo][alphaNo];
@@ -219,7 +247,7 @@ int main(int argc, char* argv[])
 
 	//load rms matrices for every bagging iteration for models already trained
 	fstream fbagrms;	
-	fbagrms.open("./AGTemp/bagrms.txt", ios_base::in); 
+	fbagrms.open(workPath("AGTemp/bagrms.txt").c_str(), ios_base::in); 
 	for(int bagNo = 0; bagNo < prev.bagN; bagNo++)
 		for(int tigNNo = 0; tigNNo < prevTiGNN; tigNNo++)
 			for(int alphaNo = 0; alphaNo < prevAlphaN; alphaNo++)
@@ -232,7 +260,7 @@ int main(int argc, char* argv[])
 	if(!ti.rms)
 	{
 		fstream fbagroc;	
-		fbagroc.open("./AGTemp/bagroc.txt", ios_base::in); 
+		fbagroc.open(workPath("AGTemp/bagroc.txt").c_str(), ios_base::in); 
 		for(int bagNo = 0; bagNo < prev.bagN; bagNo++)
 			for(int tigNNo = 0; tigNNo < prevTiGNN; tigNNo++)
 				for(int alphaNo = 0; alphaNo < prevAlphaN; alphaNo++)
@@ -249,7 +277,7 @@ int main(int argc, char* argv[])
 	if(ti.mode == FAST)
 	{//read part of the directions table from file
 		fstream fdir;	
-		fdir.open("./AGTemp/dir.txt", ios_base::in); 
+		fdir.open(workPath("AGTemp/dir.txt").c_str(), ios_base::in); 
 		for(int tigNNo = 0; tigNNo < prevTiGNN; tigNNo++)
 			for(int alphaNo = 0; alphaNo < prevAlphaN; alphaNo++)
 				fdir >> dir[tigNNo][alphaNo];
@@ -261,7 +289,7 @@ int main(int argc, char* argv[])
 	//direction of initialization (1 - up, 0 - right), collects statistics in the slow mode
 	doublevv dirStat(max(tigNN, prevTiGNN), doublev(max(alphaN, prevAlphaN), 0));
 	fstream fdirStat;	
-	fdirStat.open("./AGTemp/dirstat.txt", ios_base::in); 
+	fdirStat.open(workPath("AGTemp/dirstat.txt").c_str(), ios_base::in); 
 	for(int alphaNo = 0; alphaNo < prevAlphaN; alphaNo++)
 		for(int tigNNo = 0; tigNNo < prevTiGNN; tigNNo++)
 		{
@@ -273,8 +301,12 @@ int main(int argc, char* argv[])
 	fdirStat.close();
 
 
-	//temp files containing earlier groves on the edge of grid
-	vector<fstream*> ftemps(prevTiGNN + prevAlphaN - 1);
+	//statistics: total number of rounds of grove rebuilding and number of converged groves in every cell
+	doublevv roundsV(max(tigNN, prevTiGNN), doublev(max(alphaN, prevAlphaN), 0));
+	doublevv convN(max(tigNN, prevTiGNN), doublev(max(alphaN, prevAlphaN), 0));
+
+	//groves of all earlier runs, new groves are added to the same store
+	CGroveStore store(workPath("AGTemp"));
 
 //5. Train and save models
 	int bagNo = 0; //number of the first bagging iteration where model needs to be expanded
@@ -285,7 +317,7 @@ int main(int argc, char* argv[])
 		cout << "Iteration " << bagNo + 1 << " out of " << ti.bagN << endl;
 
 		//predictions of single trees in groves on the train set data points
-		doublevvv sinpreds(tigNN, doublevv(ti.maxTiGN, doublev(itemN, 0)));	
+		floatvvv sinpreds(tigNN, floatvv(ti.maxTiGN, floatv(itemN, 0)));	
 		//outer array: running column in surface matrix
 		//middle array: grove (multiple trees)
 		//inner array: predictions by a tree in a grove
@@ -313,12 +345,11 @@ int main(int argc, char* argv[])
 
 				int tigN = tigVal(tigNNo);	//number of trees in the current grove
 
-				//temp file that keeps models corresponding to alpha and tigN
-				string prefix = string("./AGTemp/ag.a.") 
+				//prefix of temp files related to alpha and tigN
+				string prefix = workPath("AGTemp/ag.a.") 
 									+ alphaToStr(alpha)
 									+ ".n." 
 									+ itoa(tigN, 10);
-				string tempFName = prefix + ".tmp";
 
 				if(bagNo < prev.bagN)
 				{
@@ -326,22 +357,10 @@ int main(int argc, char* argv[])
 					if((tigNNo == prevTiGNN - 1) && (alphaNo < prevAlphaN) ||
 					   (alphaNo == prevAlphaN - 1) && (tigNNo < prevTiGNN))
 					{
-						fstream*& pftemp = ftemps[tigNNo + prevAlphaN - 1 - alphaNo];
-						if(bagNo == 0)
-							pftemp = new fstream(tempFName.c_str(), ios_base::binary | ios_base::in);
-						if(pftemp->fail())
-							throw TEMP_ERR;		
-						
 						CGrove oldGrove(alpha, tigN);
-						oldGrove.load(*pftemp);
+						store.load(oldGrove, alpha, tigN, bagNo);
 
 						oldGrove.batchPredict(sinpreds[tigNNo], jointpreds[tigNNo]);
-
-						if(bagNo == prev.bagN - 1)
-						{
-							pftemp->close();
-							delete pftemp;
-						}
 					}
 					//skip the rest of the iteration when the model is already built
 					if((tigNNo < prevTiGNN) && (alphaNo < prevAlphaN))
@@ -350,6 +369,8 @@ int main(int argc, char* argv[])
 				
 				CGrove leftGrove(alpha, tigN); //(alpha, tigN) grove grown from the left neighbor
 				CGrove bottomGrove(alpha, tigN); //(alpha, tigN) grove grown from the bottom neighbor
+				leftGrove.setSeed(rand());
+				bottomGrove.setSeed(rand());
 				CGrove* winGrove = &leftGrove; //better of the two groves
 
 				//note: grove from left is automatically ready for further use,
@@ -373,7 +394,7 @@ int main(int argc, char* argv[])
 				}
 				else
 				{//build both groves, compare performances on oob data
-					doublevv sinpreds2 = sinpreds[tigNNo - 1];
+					floatvv sinpreds2 = sinpreds[tigNNo - 1];
 					doublev jointpreds2 = jointpreds[tigNNo - 1];
 
 					ddpair rmse_l = leftGrove.converge(sinpreds[tigNNo], jointpreds[tigNNo]);
@@ -390,8 +411,13 @@ int main(int argc, char* argv[])
 					}
 				}
 				
-				//add the winning grove to a model file with alpha and tigN values in the name
-				winGrove->save(tempFName.c_str());
+				roundsV[tigNNo][alphaNo] += leftGrove.getRoundN() + bottomGrove.getRoundN();
+				convN[tigNNo][alphaNo] += (leftGrove.getRoundN() > 0) + (bottomGrove.getRoundN() > 0);
+
+				//add the winning grove to the store
+				ostringstream fsave;
+				winGrove->save(fsave);
+				store.add(alpha, tigN, fsave.str());
 
 				//generate predictions for validation set
 				doublev predictions(validN);
@@ -414,9 +440,13 @@ int main(int argc, char* argv[])
 
 			}//end for(int tigNNo = 0; tigNNo < tigNN; tigNNo++) 
 		}//end for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+
+		//save groves of the whole bagging iteration with a single write
+		store.flush();
 	}// end for(; bagNo < ti.bagN; bagNo++)
 	
 //4. Output
+	logRounds(ti, roundsV, convN, itemN);
 	if(ti.rms)
 		trainOut(ti, dir, rmsV, rmsV, predsumsV, itemN, dirStat);
 	else
@@ -449,7 +479,11 @@ int main(int argc, char* argv[])
 				break;
 			case INPUT_ERR:
 				errlog << "Usage: ag_expand [-a _alpha_value_] [-n _N_value_] [-b _bagging_iterations_]"
-					<< " [-i _init_random_]\n";
+					<< " [-i _init_random_] [-h _threads_]\n"
+					<< "\t[-tol _convergence_threshold_] [-rounds _max_rounds_] [-conv bag|oob] [-wd _work_dir_]\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
 				break;
 			case ALPHA_ERR:
 				errlog << "Input error: alpha value is out of [0; previous value] range.\n";
@@ -464,6 +498,13 @@ int main(int argc, char* argv[])
 			case WIN_ERR:
 				errlog << "Input error: TreeExtra currently does not support multithreading for Windows.\n"; 
 				break;
+			case CONV_ERR:
+				errlog << "Input error: convergence threshold or max number of rounds is negative.\n"; 
+				break;
+			case PRUNE_ERR:
+				errlog << "Error: the grid of models was pruned during training, "
+					<< "pruned grids cannot be expanded. Use ag_train without -prune.\n";
+				break;
 			default:
 				throw err;
 		}
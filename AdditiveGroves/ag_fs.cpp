@@ -3,7 +3,7 @@
 //(c) Daria Sorokina
 
 //ag_fs -t _train_set_ -v _validation_set_ -r _attr_file_ -a _alpha_value_ -n _N_value_ 
-//		-b _bagging_iterations_ [-c rms|roc] [-i seed] [-m _model_file_name_] 
+//		-b _bagging_iterations_ [-c rms|roc] [-i seed] [-m _model_file_name_] [-wd _work_dir_]
 
 #include "ag_definitions.h"
 #include "functions.h"
@@ -20,7 +20,8 @@
 int main(int argc, char* argv[])
 {	
 	try{
-//0. Set log file
+//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
 	LogStream clog;
 	clog << "\n-----\nag_fs ";
 	for(int argNo = 1; argNo < argc; argNo++)
@@ -103,6 +104,8 @@ int main(int argc, char* argv[])
 			if(modelFName.empty())
 				throw EMPTY_MODEL_NAME_ERR;
 		}
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
 		else if(!args[argNo].compare("-h"))
 #ifndef _WIN32 
 			threadN = atoiExt(argv[argNo + 1]);
@@ -248,7 +251,7 @@ int main(int argc, char* argv[])
 	outEffects(data, attrs, 10, modelFName, "");
 
 	//output mean and std
-	fstream fdistr("distribution.txt", ios_base::out);
+	fstream fdistr(workPath("distribution.txt").c_str(), ios_base::out);
 	fdistr << mean << "\n" << std << "\n";
 	fdistr.close();
 
@@ -263,7 +266,10 @@ int main(int argc, char* argv[])
 			case INPUT_ERR:
 				errlog << "Usage: ag_fs -t _train_set_ -v _validation_set_ -r _attr_file_ "
 					<< "-a _alpha_value_ -n _N_value_ -b _bagging_iterations_ " 
-					<< "[-i _init_random_] [-c rms|roc] [-m _model_file_name_] \n";
+					<< "[-i _init_random_] [-c rms|roc] [-m _model_file_name_] [-wd _work_dir_]\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
 				break;
 			case ALPHA_ERR:
 				errlog << "Input error: alpha value is out of [0;1] range.\n";
@@ -6,15 +6,30 @@
 #include "functions.h"
 #include "LogStream.h"
 #include "Grove.h"
+#include "ag_definitions.h"
 
 #include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <cmath>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+//working directory of the current run: AGTemp, log.txt and output files with fixed names are kept there
+static string workDir = ".";
 
 //generates all output for train, expand and merge commands except for saving the models themselves
+//pPruned - numbers of bagging iterations after which grid cells were pruned (0 - not pruned), NULL if no pruning
 void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV, doublevvv& predsumsV, 
-			  int itemN, doublevv& dirStat, int startAlphaNo, int startTiGNNo)
+			  int itemN, doublevv& dirStat, int startAlphaNo, int startTiGNNo, intvv* pPruned)
 {
 //Generate temp files that can be used by other commands later. (in addition to saved groves)
 
@@ -24,7 +39,7 @@ void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV
 	
 	//params file is a text file
 	fstream fparam;	
-	fparam.open("./AGTemp/params.txt", ios_base::out); 
+	fparam.open(workPath("AGTemp/params.txt").c_str(), ios_base::out); 
 	//general set of parameters
 	fparam << ti.seed << '\n' << ti.trainFName << '\n' << ti.validFName << '\n' << ti.attrFName 
 		<< '\n' << ti.minAlpha << '\n' << ti.maxTiGN << '\n' << ti.bagN << '\n';
@@ -36,7 +51,7 @@ void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV
 		if(!dir.empty())
 		{
 			fstream fdir;	
-			fdir.open("./AGTemp/dir.txt", ios_base::out); 
+			fdir.open(workPath("AGTemp/dir.txt").c_str(), ios_base::out); 
 			for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
 			{
 				for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
@@ -57,11 +72,14 @@ void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV
 	else
 		fparam << "roc" << endl;
 
+	//convergence criteria
+	fparam << ti.convTol << '\n' << ti.maxRounds << '\n' << (ti.oobStop ? "oob" : "bag") << endl;
+
 	fparam.close();
 
 	//save rms performance matrices for every bagging iteration
 	fstream fbagrms;	
-	fbagrms.open("./AGTemp/bagrms.txt", ios_base::out); 
+	fbagrms.open(workPath("AGTemp/bagrms.txt").c_str(), ios_base::out); 
 	for(int bagNo = 0; bagNo < ti.bagN; bagNo++)
 	{
 		fbagrms << endl;
@@ -78,7 +96,7 @@ void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV
 	if(!ti.rms)
 	{
 		fstream fbagroc;	
-		fbagroc.open("./AGTemp/bagroc.txt", ios_base::out); 
+		fbagroc.open(workPath("AGTemp/bagroc.txt").c_str(), ios_base::out); 
 		for(int bagNo = 0; bagNo < ti.bagN; bagNo++)
 		{
 			fbagroc << endl;
@@ -94,21 +112,32 @@ void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV
 
 	//save sums of predictions on the last bagging iteration
 	fstream fsums;	
-	fsums.open("./AGTemp/predsums.bin", ios_base::binary | ios_base::out);
+	fsums.open(workPath("AGTemp/predsums.bin").c_str(), ios_base::binary | ios_base::out);
 	fsums << predsumsV;
 	fsums.close();
 
+	//save the pruning table, its presence marks that groves in the pruned cells are incomplete
+	if(pPruned)
+	{
+		fstream fpruned;	
+		fpruned.open(workPath("AGTemp/pruned.txt").c_str(), ios_base::out); 
+		for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+		{
+			for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
+				fpruned << (*pPruned)[tigNNo][alphaNo] << " \t";
+			fpruned << endl;
+		}
+		fpruned.close();
+	}
+
 
 //Generate the actual output of the program
 
 	//performance table on the last iteration of bagging
 	fstream fsurface;	//output text file with performance matrix
-	fsurface.open("performance.txt", ios_base::out); 
+	fsurface.open(workPath("performance.txt").c_str(), ios_base::out); 
 
-	double bestPerf;					//best performance on validation set
-	int bestTiGNNo, bestAlphaNo;		//ids of parameters that produce best performance
-	int bestTiGN; double bestAlpha;		//parameters that produce best performance
-	//output performance matrix, find best performance and corresponding parameter values
+	//output performance matrix
 	for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
 	{
 		int tigN = tigVal(tigNNo);
@@ -121,26 +150,16 @@ void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV
 				alpha = ti.minAlpha;
 			
 			//output a single grid point with coordinates
-			double& curPerf = surfaceV[tigNNo][alphaNo][ti.bagN - 1];
-			fsurface << alpha << " \t" << tigN << " \t" << curPerf << endl;
-
-			//check for the best result inside the active output area
-			if((tigNNo >= startTiGNNo) && (alphaNo >= startAlphaNo))
-				if((tigNNo == startTiGNNo) && (alphaNo == startAlphaNo) || 
-					ti.rms && (curPerf < bestPerf) ||
-					!ti.rms && (curPerf > bestPerf) ||
-					((curPerf == bestPerf) && //if the result is the same, choose the less complex model
-						(pow((double)2, alphaNo) * tigN < pow((double)2, bestAlphaNo) * bestTiGN))
-					)	
-				{
-					bestTiGNNo = tigNNo;
-					bestTiGN = tigN;
-					bestAlphaNo = alphaNo;
-					bestAlpha = alpha;
-					bestPerf = curPerf;
-				}
+			fsurface << alpha << " \t" << tigN << " \t" << surfaceV[tigNNo][alphaNo][ti.bagN - 1] << endl;
 		}		
 	}
+
+	//find best performance and corresponding parameter values inside the active output area
+	int bestTiGNNo, bestAlphaNo;		//ids of parameters that produce best performance
+	findBest(ti, surfaceV, ti.bagN, itemN, bestTiGNNo, bestAlphaNo, startAlphaNo, startTiGNNo, pPruned);
+	double bestPerf = surfaceV[bestTiGNNo][bestAlphaNo][ti.bagN - 1];	//best performance on validation set
+	int bestTiGN = tigVal(bestTiGNNo);	//parameters that produce best performance
+	double bestAlpha = (bestAlphaNo < alphaN - 1) ? alphaVal(bestAlphaNo) : ti.minAlpha;
 	
 	fsurface << "\n\n";
 
@@ -151,10 +170,23 @@ void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV
 			fsurface << surfaceV[tigNNo][alphaNo][ti.bagN - 1] << " \t";
 		fsurface << endl;
 	}
+
+	//list pruned cells, their performance is given for the last bagging iteration before pruning
+	if(pPruned)
+	{
+		fsurface << "\n\nPruned models (alpha, N, bagging iterations):\n";
+		for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
+			for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+				if((*pPruned)[tigNNo][alphaNo])
+				{
+					double alpha = (alphaNo < alphaN - 1) ? alphaVal(alphaNo) : ti.minAlpha;
+					fsurface << alpha << " \t" << tigVal(tigNNo) << " \t" << (*pPruned)[tigNNo][alphaNo] << endl;
+				}
+	}
 	fsurface.close();
 
 	fstream fdirStat;	
-	fdirStat.open("./AGTemp/dirstat.txt", ios_base::out);
+	fdirStat.open(workPath("AGTemp/dirstat.txt").c_str(), ios_base::out);
 	//output directions stats in the form of matrix
 	for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
 	{
@@ -169,14 +201,14 @@ void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV
 		//bestPerf will be used in the output on the next iteration, others are used by ag_save.exe
 	//best.txt file is a text file
 	fstream fbest;
-	fbest.open("./AGTemp/best.txt", ios_base::out); 
+	fbest.open(workPath("AGTemp/best.txt").c_str(), ios_base::out); 
 	fbest << bestPerf << '\n' << bestTiGN << '\n' << bestAlpha << '\n' << ti.bagN << '\n' << itemN 
 		<< endl;
 	fbest.close();	
 
 	//output rms bagging curve in the best (alpha, TiGN) point
 	fstream frmscurve;	//output text file 
-	frmscurve.open("bagging_rms.txt", ios_base::out); 
+	frmscurve.open(workPath("bagging_rms.txt").c_str(), ios_base::out); 
 	for(int bagNo = 0; bagNo < ti.bagN; bagNo++)
 		frmscurve << rmsV[bestTiGNNo][bestAlphaNo][bagNo] << endl;
 	frmscurve.close();
@@ -185,16 +217,14 @@ void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV
 	if(!ti.rms)
 	{
 		fstream froccurve;	//output text file 
-		froccurve.open("bagging_roc.txt", ios_base::out); 
+		froccurve.open(workPath("bagging_roc.txt").c_str(), ios_base::out); 
 		for(int bagNo = 0; bagNo < ti.bagN; bagNo++)
 			froccurve << surfaceV[bestTiGNNo][bestAlphaNo][bagNo] << endl;
 		froccurve.close();
 	}
 
-	//analyze whether more bagging should be recommended based on the rms curve in the best point
-	bool recBagging = moreBag(rmsV[bestTiGNNo][bestAlphaNo]);
-	//and based on the curve in a more complex point (if there is one)
-	recBagging |= moreBag(rmsV[min(bestTiGNNo + 1, tigNN - 1)][min(bestAlphaNo + 1, alphaN - 1)]);
+	//analyze whether more bagging should be recommended
+	bool recBagging = gridMoreBag(rmsV, ti.bagN, bestTiGNNo, bestAlphaNo);
 		
 	//output results and recommendations
 	clog << "Best model:\n\tAlpha = " << bestAlpha << "\n\tN = " << bestTiGN;
@@ -208,8 +238,11 @@ void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV
 	if( (ti.rms && (bestPerf != 0) || !ti.rms && (bestPerf != 1)) &&
 		(((bestAlpha == ti.minAlpha) && (ti.minAlpha != 0)) || (bestTiGN == ti.maxTiGN) || recBagging))
 	{
-		clog << "\nRecommendation: relaxing model parameters might produce a better model.\n"
-			<< "Suggested action: ag_expand";
+		clog << "\nRecommendation: relaxing model parameters might produce a better model.\n";
+		if(pPruned)	//pruned grid cannot be expanded
+			clog << "Suggested action: ag_train with the same data and";
+		else
+			clog << "Suggested action: ag_expand";
 		if((bestAlpha == ti.minAlpha) && (ti.minAlpha != 0))
 		{
 			double recAlpha = ti.minAlpha * 0.1;
@@ -236,6 +269,223 @@ void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV
 	clog << "\n";
 }
 
+//Finds the best point of the grid by performance after bagN bagging iterations.
+//Only the area with alphaNo >= startAlphaNo and tigNNo >= startTiGNNo is considered.
+//If the performance is the same, the less complex model is chosen
+//Pruned cells (pPruned is not NULL and has a nonzero value for them) are skipped
+void findBest(TrainInfo& ti, doublevvv& surfaceV, int bagN, int itemN, int& bestTiGNNo, int& bestAlphaNo, 
+			  int startAlphaNo, int startTiGNNo, intvv* pPruned)
+{
+	int alphaN = getAlphaN(ti.minAlpha, itemN); //number of different alpha values
+	int tigNN = getTiGNN(ti.maxTiGN);	//number of different tigN values
+
+	double bestPerf;	//best performance on validation set
+	int bestTiGN;		//tigN value that produces best performance
+	bool found = false;	//whether any cell was checked already
+	for(int tigNNo = startTiGNNo; tigNNo < tigNN; tigNNo++)
+	{
+		int tigN = tigVal(tigNNo);
+		for(int alphaNo = startAlphaNo; alphaNo < alphaN; alphaNo++)
+		{
+			if(pPruned && (*pPruned)[tigNNo][alphaNo])
+				continue;
+
+			double& curPerf = surfaceV[tigNNo][alphaNo][bagN - 1];
+			if(!found || 
+				ti.rms && (curPerf < bestPerf) ||
+				!ti.rms && (curPerf > bestPerf) ||
+				((curPerf == bestPerf) && //if the result is the same, choose the less complex model
+					(pow((double)2, alphaNo) * tigN < pow((double)2, bestAlphaNo) * bestTiGN))
+				)	
+			{
+				bestTiGNNo = tigNNo;
+				bestTiGN = tigN;
+				bestAlphaNo = alphaNo;
+				bestPerf = curPerf;
+				found = true;
+			}
+		}
+	}
+}
+
+//Checks whether more bagging is needed, based on the rms bagging curve (first bagN iterations) in the best point 
+//of the grid and in the closest more complex point (if there is one)
+bool gridMoreBag(doublevvv& rmsV, int bagN, int bestTiGNNo, int bestAlphaNo)
+{
+	int tigNN = (int)rmsV.size();
+	int alphaN = (int)rmsV[0].size();
+
+	doublev& bestCurve = rmsV[bestTiGNNo][bestAlphaNo];
+	doublev& complexCurve = rmsV[min(bestTiGNNo + 1, tigNN - 1)][min(bestAlphaNo + 1, alphaN - 1)];
+
+	return moreBag(doublev(bestCurve.begin(), bestCurve.begin() + bagN)) 
+		|| moreBag(doublev(complexCurve.begin(), complexCurve.begin() + bagN));
+}
+
+//checks whether the grid in the given directory was trained with pruning: 
+//in this case AGTemp/pruned.txt exists and some of the temp files with groves are incomplete
+bool isPruned(string dirName)
+{
+	string prunedFName = dirName + "/AGTemp/pruned.txt";
+	fstream fpruned(prunedFName.c_str(), ios_base::in);
+	return !fpruned.fail();
+}
+
+//finds the working directory in the command line (-wd flag), returns current directory if it is not set.
+//The working directory is needed before the rest of arguments is parsed, because the log is kept there.
+//Arguments after -d are names of input directories of ag_merge, they are not checked
+string getWorkDir(int argc, char* argv[])
+{
+	for(int argNo = 1; argNo < argc - 1; argNo += 2)
+	{
+		string flag(argv[argNo]);
+		if(!flag.compare("-d"))
+			break;
+		if(!flag.compare("-wd"))
+			return string(argv[argNo + 1]);
+	}
+	return ".";
+}
+
+//sets the working directory for temp files, log and output files with fixed names. 
+//Commands that start a new grid create the directory if it does not exist, other commands require it to exist
+void setWorkDir(string dirName, bool create)
+{
+	if(dirName.empty())
+		throw WORKDIR_ERR;
+
+	struct stat status;
+	if(stat(dirName.c_str(), &status) != 0)
+	{
+		if(!create)
+			throw WORKDIR_ERR;
+#ifdef _WIN32
+		CreateDirectory(dirName.c_str(), NULL);
+#else
+		mkdir(dirName.c_str(), 0777);
+#endif
+		if(stat(dirName.c_str(), &status) != 0)
+			throw WORKDIR_ERR;
+	}
+	if(!(status.st_mode & S_IFDIR))
+		throw WORKDIR_ERR;
+
+	workDir = dirName;
+	LogStream::setDir(dirName);
+}
+
+//returns path to a file or a subdirectory of the working directory, the directory itself for an empty name
+string workPath(string fileName)
+{
+	if(fileName.empty())
+		return workDir;
+	return workDir + "/" + fileName;
+}
+
+#ifndef _WIN32
+//deletes a directory with all its contents
+static void removeDir(string dirName)
+{
+	DIR* pDir = opendir(dirName.c_str());
+	if(pDir == NULL)
+		return;
+
+	struct dirent* pEntry;
+	while((pEntry = readdir(pDir)) != NULL)
+	{
+		string entryName(pEntry->d_name);
+		if(!entryName.compare(".") || !entryName.compare(".."))
+			continue;
+
+		string fullName = dirName + "/" + entryName;
+		struct stat status;
+		if((lstat(fullName.c_str(), &status) == 0) && S_ISDIR(status.st_mode))
+			removeDir(fullName);
+		else
+			unlink(fullName.c_str());
+	}
+	closedir(pDir);
+	rmdir(dirName.c_str());
+}
+#endif
+
+//deletes the temp directory AGTemp with all files from previous runs and creates it again
+void resetTempDir()
+{
+	string tempDir = workPath("AGTemp");
+#ifdef _WIN32
+	WIN32_FIND_DATA fn;			//structure that will contain the name of file
+	HANDLE hFind = FindFirstFile((tempDir + "/*.*").c_str(), &fn);	//"."
+	if(hFind != INVALID_HANDLE_VALUE)
+	{
+		FindNextFile(hFind, &fn);						//".." 
+		//delete all files in the directory
+		while(FindNextFile(hFind, &fn) != 0) 
+		{
+			string fullName = tempDir + "/" + (string)fn.cFileName;
+			DeleteFile(fullName.c_str());
+		} 
+		FindClose(hFind);
+	}
+	CreateDirectory(tempDir.c_str(), NULL);
+#else 
+	removeDir(tempDir);
+	mkdir(tempDir.c_str(), 0777);
+#endif
+}
+
+//reads convergence criteria from the end of AGTemp/params.txt. 
+//Temp files created by older versions do not have them, default values are kept in this case
+void readConvParams(fstream& fparam, TrainInfo& ti)
+{
+	double convTol;
+	int maxRounds;
+	string convStr;
+	fparam >> convTol >> maxRounds >> convStr;
+	if(fparam.fail() || (convStr.compare("bag") && convStr.compare("oob")))
+		return;
+	ti.convTol = convTol;
+	ti.maxRounds = maxRounds;
+	ti.oobStop = !convStr.compare("oob");
+}
+
+//outputs convergence criteria into the log, if they are different from default ones
+void logConvergence(TrainInfo& ti)
+{
+	TrainInfo defTI;
+	if((ti.convTol == defTI.convTol) && (ti.maxRounds == defTI.maxRounds) && (ti.oobStop == defTI.oobStop))
+		return;
+
+	LogStream clog;
+	clog << "Convergence threshold = " << ti.convTol << "\n";
+	if(ti.maxRounds > 0)
+		clog << "Max number of rounds = " << ti.maxRounds << "\n";
+	if(ti.oobStop)
+		clog << "Stop when out-of-bag rmse stalls\n";
+	clog << "\n";
+}
+
+//outputs average number of rounds of grove rebuilding in every cell of the grid into the log
+//roundsV - total numbers of rounds, convN - numbers of calls of converge in each cell
+void logRounds(TrainInfo& ti, doublevv& roundsV, doublevv& convN, int itemN)
+{
+	LogStream clog;
+	int alphaN = getAlphaN(ti.minAlpha, itemN); //number of different alpha values
+	int tigNN = getTiGNN(ti.maxTiGN);	//number of different tigN values
+
+	clog << "Average number of rounds to convergence (rows - alpha, columns - N):\n";
+	for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+	{
+		for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
+			if(convN[tigNNo][alphaNo] == 0)
+				clog << "- \t";
+			else
+				clog << roundsV[tigNNo][alphaNo] / convN[tigNNo][alphaNo] << " \t";
+		clog << "\n";
+	}
+	clog << "\n";
+}
+
 //saves a vector into a binary file
 fstream& operator << (fstream& fbin, doublev& vec)
 {
@@ -421,6 +671,7 @@ double layeredGroves(INDdata& data, TrainInfo& ti, string modelFName)
 	{
 		cout << "\t\tIteration " << bagNo + 1 << " out of " << ti.bagN << endl;
 		CGrove grove(ti.minAlpha, ti.maxTiGN, ti.interaction);
+		grove.setSeed(rand());
 		grove.trainLayered();
 		for(int itemNo = 0; itemNo < validN; itemNo++)
 			predsumsV[itemNo] += grove.predict(itemNo, VALID);
@@ -480,6 +731,89 @@ void rerase(intv& vec, intv::reverse_iterator& reverse)
 	vec.erase(straight);
 }
 
+//reads the header of a model file of version 1: training mode, directions on the grid for the fast mode,
+//max number of trees in a grove, min alpha
+void readModelHeader(istream& fmodel, TrainInfo& ti, boolv& dirs)
+{
+	dirs.clear();
+	fmodel.read((char*) &ti.mode, sizeof(enum AG_TRAIN_MODE));
+	if(ti.mode == FAST)
+	{
+		int dirN = 0;
+		fmodel.read((char*) &dirN, sizeof(int));
+		if(fmodel.fail() || (dirN < 0))
+			throw MODEL_ERR;
+		dirs.resize(dirN);
+		for(int dirNo = 0; dirNo < dirN; dirNo++)
+		{
+			bool dir = false;
+			fmodel.read((char*) &dir, sizeof(bool));
+			dirs[dirNo] = dir;
+		}
+	}
+	fmodel.read((char*) &ti.maxTiGN, sizeof(int));
+	fmodel.read((char*) &ti.minAlpha, sizeof(double));
+	if(fmodel.fail() || (ti.maxTiGN < 1))
+		throw MODEL_ERR;
+}
+
+//writes the header of a model file of version 1
+void writeModelHeader(ostream& fmodel, TrainInfo& ti, boolv& dirs)
+{
+	fmodel.write((char*) &ti.mode, sizeof(enum AG_TRAIN_MODE));
+	if(ti.mode == FAST)
+	{
+		int dirN = (int)dirs.size();
+		fmodel.write((char*) &dirN, sizeof(int));
+		for(int dirNo = 0; dirNo < dirN; dirNo++)
+		{
+			bool dir = dirs[dirNo];
+			fmodel.write((char*) &dir, sizeof(bool));
+		}
+	}
+	fmodel.write((char*) &ti.maxTiGN, sizeof(int));
+	fmodel.write((char*) &ti.minAlpha, sizeof(double));
+	if(fmodel.fail())
+		throw TREE_WRITE_ERR;
+}
+
+//loads a model file into a compiled model, returns the number of groves (bagging iterations).
+//A file of version 2 is mapped into memory, groves of a file of version 1 are loaded and compiled one by one
+int loadModel(string modelFName, INDdata& data, TrainInfo& ti, CCompiledModel& model, boolv* pDirs, 
+			  bool showProgress)
+{
+	boolv dirs;
+	if(pDirs == NULL)
+		pDirs = &dirs;
+	if(CCompiledModel::isMappable(modelFName.c_str()))
+	{
+		ModelFileHeader header;
+		model.map(modelFName.c_str(), header, *pDirs);
+		if((header.attrHash != data.getAttrHash()) || !model.activeAttrs(data))
+			throw MODEL_ATTR_MISMATCH_ERR;
+		ti.mode = (AG_TRAIN_MODE) header.mode;
+		ti.maxTiGN = header.maxTiGN;
+		ti.minAlpha = header.minAlpha;
+		return header.groupN;
+	}
+
+	fstream fmodel(modelFName.c_str(), ios_base::binary | ios_base::in);
+	readModelHeader(fmodel, ti, *pDirs);
+	int bagN = 0;
+	while(fmodel.peek() != char_traits<char>::eof())
+	{//load next Grove in the ensemble 
+		bagN++;
+		if(showProgress)
+			cout << "Iteration " << bagN << endl;
+		CGrove grove(ti.minAlpha, ti.maxTiGN);
+		grove.load(fmodel);
+		grove.compile(model);
+	}
+	if(bagN == 0)
+		throw MODEL_ERR;
+	return bagN;
+}
+
 //calculate and output separate effects of several attributes in a model
 void outEffects(INDdata& data, intv attrIds, int quantN, string modelFName, string outFName /*valid only for 1 attribute*/)
 {
@@ -503,45 +837,20 @@ void outEffects(INDdata& data, intv attrIds, int quantN, string modelFName, stri
 		}
 	}
 
-	//2. Open model file, read its header
-	fstream fmodel(modelFName.c_str(), ios_base::binary | ios_base::in);
+	//2. Load the model
 	TrainInfo ti;
-	fmodel.read((char*) &ti.mode, sizeof(enum AG_TRAIN_MODE));
-	if(ti.mode == FAST)
-	{//skip information about fast training - it is not used in this command
-		int dirN = 0;
-		fmodel.read((char*) &dirN, sizeof(int));
-		bool dirStub = false;
-		for(int dirNo = 0; dirNo < dirN; dirNo++)
-			fmodel.read((char*) &dirStub, sizeof(bool));
-	}
-	fmodel.read((char*) &ti.maxTiGN, sizeof(int));
-	fmodel.read((char*) &ti.minAlpha, sizeof(double));
-	if(fmodel.fail() || (ti.maxTiGN < 1))
-		throw MODEL_ERR;
-
-	//3. Read models, calculate predictions for fake points
+	CCompiledModel model;	//all groves of the model in flat arrays
+	ti.bagN = loadModel(modelFName, data, ti, model);
 
+	//3. Calculate predictions for fake points
 	doublevv pdfVals(outAttrN);
 	for(int attrNo = 0; attrNo < outAttrN; attrNo++)
 		pdfVals[attrNo].resize(uValsNs[attrNo], 0); //partial dependence function values
 
-	ti.bagN = 0;
-	while(fmodel.peek() != char_traits<char>::eof())
-	{//load next Grove in the ensemble 
-		ti.bagN++;
-		CGrove grove(ti.minAlpha, ti.maxTiGN);
-		grove.load(fmodel);
-
-		//calculate partial dependence function values (predictions on quantile points)
-		for(int attrNo = 0; attrNo < outAttrN; attrNo++)
-			for(int uValNo = 0; uValNo < uValsNs[attrNo]; uValNo++)
-				pdfVals[attrNo][uValNo] += grove.predict(fakePointsIds[attrNo][uValNo], TEST);
-	}
-	//normalize bagged predictions of the ensemble
+	//calculate bagged partial dependence function values (predictions on quantile points)
 	for(int attrNo = 0; attrNo < outAttrN; attrNo++)
 		for(int uValNo = 0; uValNo < uValsNs[attrNo]; uValNo++)
-			pdfVals[attrNo][uValNo] /= ti.bagN;
+			pdfVals[attrNo][uValNo] = model.predict(data.getRow(fakePointsIds[attrNo][uValNo], TEST)) / ti.bagN;
 
 	//4. Output
 	for(int attrNo = 0; attrNo < outAttrN; attrNo++)
@@ -608,49 +917,22 @@ void outIPlots(INDdata& data, iipairv interactions, int quantN1, int quantN2, st
 			}
 	}
 
-//2. Open model file, read its header
-	fstream fmodel(modelFName.c_str(), ios_base::binary | ios_base::in);
+//2. Load the model
 	TrainInfo ti;
-	fmodel.read((char*) &ti.mode, sizeof(enum AG_TRAIN_MODE));
-	if(ti.mode == FAST)
-	{//skip information about fast training - it is not used in this command
-		int dirN = 0;
-		fmodel.read((char*) &dirN, sizeof(int));
-		bool dirStub = false;
-		for(int dirNo = 0; dirNo < dirN; dirNo++)
-			fmodel.read((char*) &dirStub, sizeof(bool));
-	}
-	fmodel.read((char*) &ti.maxTiGN, sizeof(int));
-	fmodel.read((char*) &ti.minAlpha, sizeof(double));
-	if(fmodel.fail() || (ti.maxTiGN < 1))
-		throw MODEL_ERR;
-
-
-//3. Read models, calculate predictions for quantile points
+	CCompiledModel model;	//all groves of the model in flat arrays
+	ti.bagN = loadModel(modelFName, data, ti, model);
 
+//3. Calculate predictions for quantile points
 	doublevvv pdfVals(iN); //partial dependence function values
 	for(int iNo = 0; iNo < iN; iNo++)
 		pdfVals[iNo].resize(uValsNs1[iNo], doublev(uValsNs2[iNo], 0)); 
 
-	ti.bagN = 0;
-	while(fmodel.peek() != char_traits<char>::eof())
-	{//load next Grove in the ensemble 
-		ti.bagN++;
-		CGrove grove(ti.minAlpha, ti.maxTiGN);
-		grove.load(fmodel);
-
-		//calculate partial dependence function values (predictions on quantile points)
-		for(int iNo = 0; iNo < iN; iNo++)
-			for(int uValNo1 = 0; uValNo1 < uValsNs1[iNo]; uValNo1++)
-				for(int uValNo2 = 0; uValNo2 < uValsNs2[iNo]; uValNo2++)
-					pdfVals[iNo][uValNo1][uValNo2] 
-						+= grove.predict(quantPointIds[iNo][uValNo1][uValNo2], TEST);
-	}
-	//normalize bagged predictions of the ensemble
+	//calculate bagged partial dependence function values (predictions on quantile points)
 	for(int iNo = 0; iNo < iN; iNo++)
 		for(int uValNo1 = 0; uValNo1 < uValsNs1[iNo]; uValNo1++)
 			for(int uValNo2 = 0; uValNo2 < uValsNs2[iNo]; uValNo2++)
-				pdfVals[iNo][uValNo1][uValNo2] /= ti.bagN;
+				pdfVals[iNo][uValNo1][uValNo2] 
+					= model.predict(data.getRow(quantPointIds[iNo][uValNo1][uValNo2], TEST)) / ti.bagN;
 
 //4. Output 
 	for(int iNo = 0; iNo < iN; iNo++)
@@ -4,6 +4,7 @@
 #include "definitions.h"
 #include "TrainInfo.h"
 #include "INDdata.h"
+#include "CompiledModel.h"
 
 //saves a vector into a binary file
 fstream& operator << (fstream& fbin, doublev& vec);
@@ -25,7 +26,38 @@ fstream& operator >> (fstream& fbin, doublevvv& trivec);
 
 //generates output files for train and expand commands
 void trainOut(TrainInfo& ti, doublevv& dir, doublevvv& rmsV, doublevvv& surfaceV, doublevvv& predsumsV, 
-			  int itemN, doublevv& dirStat, int startAlphaNo = 0, int startTiGNNo = 0);
+			  int itemN, doublevv& dirStat, int startAlphaNo = 0, int startTiGNNo = 0, intvv* pPruned = NULL);
+
+//finds the best point of the grid by performance after bagN bagging iterations
+void findBest(TrainInfo& ti, doublevvv& surfaceV, int bagN, int itemN, int& bestTiGNNo, int& bestAlphaNo, 
+			  int startAlphaNo = 0, int startTiGNNo = 0, intvv* pPruned = NULL);
+
+//checks whether the grid in the given directory was trained with pruning
+bool isPruned(string dirName);
+
+//finds the working directory in the command line (-wd flag), returns current directory if it is not set
+string getWorkDir(int argc, char* argv[]);
+
+//sets the working directory for temp files, log and output files with fixed names, creates it if asked
+void setWorkDir(string dirName, bool create = false);
+
+//returns path to a file or a subdirectory of the working directory, the directory itself for an empty name
+string workPath(string fileName);
+
+//deletes the temp directory AGTemp with all files from previous runs and creates it again
+void resetTempDir();
+
+//checks whether more bagging is needed based on rms curves around the best point of the grid
+bool gridMoreBag(doublevvv& rmsV, int bagN, int bestTiGNNo, int bestAlphaNo);
+
+//reads optional convergence criteria from AGTemp/params.txt
+void readConvParams(fstream& fparam, TrainInfo& ti);
+
+//outputs non-default convergence criteria into the log
+void logConvergence(TrainInfo& ti);
+
+//outputs average number of rounds to convergence for every cell of the grid into the log
+void logRounds(TrainInfo& ti, doublevv& roundsV, doublevv& convN, int itemN);
 
 //converts the number of a valid alpha value into the actual value
 double alphaVal(int alphaNo);
@@ -54,6 +86,17 @@ double meanLG(INDdata& db, TrainInfo ti, int repeatN, double& resStd, string mod
 //implementation for erase for reverse iterator
 void rerase(intv& vec, intv::reverse_iterator& iter);
 
+//reads the header of a model file of version 1, dirs are directions on the training grid (fast mode only)
+void readModelHeader(istream& fmodel, TrainInfo& ti, boolv& dirs);
+
+//writes the header of a model file of version 1
+void writeModelHeader(ostream& fmodel, TrainInfo& ti, boolv& dirs);
+
+//loads a model file of either version into a compiled model, sets training parameters, returns number of groves.
+//pDirs receives directions on the training grid, showProgress prints loaded groves of a file of version 1
+int loadModel(string modelFName, INDdata& data, TrainInfo& ti, CCompiledModel& model, boolv* pDirs = NULL, 
+			  bool showProgress = false);
+
 //calculate and output effect of an attribute in a model
 void outEffects(INDdata& data, intv attrIds, int quantN, string modelFName, string outFName);
 
@@ -4,6 +4,7 @@
 
 //ag_interactions -t _train_set_ -v _validation_set_ -r _attr_file_ -a _alpha_value_ -n _N_value_ 
 //		-b _bagging_iterations_ [-ave _mean_performance_] [-std _std_of_performance_] [-c rms|roc] [-i _seed_]
+//		[-wd _work_dir_]
 //		[-m _model_file_name_]
 
 #include "ag_definitions.h"
@@ -21,7 +22,8 @@
 int main(int argc, char* argv[])
 {	
 	try{
-//0. Set log file
+//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
 	LogStream clog;
 	clog << "\n-----\nag_interactions ";
 	for(int argNo = 1; argNo < argc; argNo++)
@@ -113,6 +115,8 @@ int main(int argc, char* argv[])
 			ti.seed = atoiExt(argv[argNo + 1]);
 		else if(!args[argNo].compare("-m"))
 			modelFName = args[argNo + 1];
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
 		else if(!args[argNo].compare("-h"))
 #ifndef _WIN32 
 			threadN = atoiExt(argv[argNo + 1]);
@@ -138,7 +142,7 @@ int main(int argc, char* argv[])
 	if(!(hasMean && hasStD))
 	{
 		fstream fdistr;
-		fdistr.open("distribution.txt", ios_base::in);
+		fdistr.open(workPath("distribution.txt").c_str(), ios_base::in);
 		fdistr >> meanPerf;
 		fdistr >> stdPerf;
 		if(fdistr.fail())
@@ -233,7 +237,10 @@ int main(int argc, char* argv[])
 			case INPUT_ERR:
 				errlog << "Usage: ag_interactions -t _train_set_ -v _validation_set_ -r _attr_file_ "
 					<< "-a _alpha_value_ -n _N_value_ -b _bagging_iterations_ [-ave _mean_performance_] "
-					<< "[-std _std_of_performance_] [-i _init_random_] [-c rms|roc]\n";
+					<< "[-std _std_of_performance_] [-i _init_random_] [-c rms|roc] [-wd _work_dir_]\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
 				break;
 			case ALPHA_ERR:
 				errlog << "Input error: alpha value is out of [0;1] range.\n";
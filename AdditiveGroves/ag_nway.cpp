@@ -4,7 +4,7 @@
 
 //ag_nway -t _train_set_ -v _validation_set_ -r _attr_file_ -a _alpha_value_ -n _N_value_ 
 //		-b _bagging_iterations_ -ave _mean_performance_ -std _std_of_performance_ -w _interaction_file_
-//		[-c rms|roc] [-i _seed_] [-m _model_file_name_] 
+//		[-c rms|roc] [-i _seed_] [-m _model_file_name_] [-wd _work_dir_]
 
 #include "ag_definitions.h"
 #include "functions.h"
@@ -21,7 +21,8 @@
 int main(int argc, char* argv[])
 {	
 	try{
-//0. Set log file
+//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
 	LogStream clog;
 	clog << "\n-----\nag_nway ";
 	for(int argNo = 1; argNo < argc; argNo++)
@@ -125,6 +126,8 @@ int main(int argc, char* argv[])
 			if(modelFName.empty())
 				throw EMPTY_MODEL_NAME_ERR;
 		}
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
 		else if(!args[argNo].compare("-h"))
 #ifndef _WIN32 
 			threadN = atoiExt(argv[argNo + 1]);
@@ -231,7 +234,10 @@ int main(int argc, char* argv[])
 				errlog << "Usage: ag_nway -t _train_set_ -v _validation_set_ -r _attr_file_ "
 					<< "-a _alpha_value_ -n _N_value_ -b _bagging_iterations_ -ave _mean_performance_ "
 					<< "-std _std_of_performance_ -w _interaction_file_ [-i _init_random_] [-c rms|roc] "
-					<< "[-m _model_file_name_] \n";
+					<< "[-m _model_file_name_] [-wd _work_dir_]\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
 				break;
 			case ALPHA_ERR:
 				errlog << "Input error: alpha value is out of [0;1] range.\n";
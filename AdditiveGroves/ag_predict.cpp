@@ -3,6 +3,7 @@
 //(c) Daria Sorokina
 
 #include "Grove.h"
+#include "ag_functions.h"
 #include "TrainInfo.h"
 #include "LogStream.h"
 #include "ErrLogStream.h"
@@ -10,12 +11,80 @@
 #include "ag_definitions.h"
 
 #include <errno.h>
+#include <math.h>
 
-//ag_predict -p _test_set_ -r _attr_file_ [-m _model_file_name_] [-o _output_file_name_] [-c rms|roc]
+//reads the test set chunk by chunk and outputs predictions for every chunk right away, so that 
+//only one chunk of the test set is kept in memory. "-" stands for standard input / output
+void streamPredict(INDdata& data, CCompiledModel& model, TrainInfo& ti, string predFName, int chunkN)
+{
+	LogStream clog;
+
+	istream* pIn = &cin;
+	fstream ftest;
+	if(ti.testFName.compare("-"))
+	{
+		ftest.open(ti.testFName.c_str(), ios_base::in);
+		if(ftest.fail())
+			throw OPEN_TEST_ERR;
+		pIn = &ftest;
+	}
+	ostream* pOut = &cout;
+	fstream fpreds;
+	if(predFName.compare("-"))
+	{
+		fpreds.open(predFName.c_str(), ios_base::out);
+		pOut = &fpreds;
+	}
+
+	doublev testTar;
+	doublev preds;
+	vector<const float*> rows;
+	int lineNo = 0;			//number of lines read so far
+	double mse = 0;			//sum of squared errors on all chunks
+	bool trueTest = true;	//all chunks have true values of the response
+	while(data.readTestChunk(*pIn, chunkN, lineNo) > 0)
+	{
+		int testN = data.getTargets(testTar, TEST);
+		rows.resize(testN);
+		for(int itemNo = 0; itemNo < testN; itemNo++)
+			rows[itemNo] = data.getRow(itemNo, TEST);
+		model.predictBatch(rows, preds);
+
+		for(int itemNo = 0; itemNo < testN; itemNo++)
+		{
+			preds[itemNo] /= ti.bagN;
+			*pOut << preds[itemNo] << "\n";
+		}
+		pOut->flush();
+
+		trueTest = trueTest && data.hasTrueTest();
+		if(trueTest)
+			for(int itemNo = 0; itemNo < testN; itemNo++)
+				mse += pow(diff10d(preds[itemNo], testTar[itemNo]), 2);
+	}
+	fpreds.close();
+
+	clog << lineNo << " points in the test set\n";
+	if(trueTest && (lineNo > 0))
+	{
+		if(ti.rms)
+			clog << "\nRMSE: " << sqrt(mse / lineNo) << "\n";
+		else
+			clog << "\nROC is not calculated when the test set is read in chunks.\n";
+	}
+}
+
+//ag_predict -p _test_set_ -r _attr_file_ [-m _model_file_name_] [-o _output_file_name_] [-c rms|roc] 
+//		[-h _threads_] [-chunk _chunk_size_] [-qs on|off] [-wd _work_dir_]
 int main(int argc, char* argv[])
 {	 
 	try{
-	//0. Set log file
+	//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
+	//predictions written to standard output should not be mixed with log messages
+	for(int argNo = 1; argNo + 1 < argc; argNo += 2)
+		if(!string(argv[argNo]).compare("-o") && !string(argv[argNo + 1]).compare("-"))
+			LogStream::doOut = false;
 	LogStream clog;
 	clog << "\n-----\nag_predict ";
 	for(int argNo = 1; argNo < argc; argNo++)
@@ -25,6 +94,9 @@ int main(int argc, char* argv[])
 	//1. Set default values of parameters
 	string modelFName = "model.bin";	//name of the input file for the model
 	string predFName = "preds.txt";		//name of the output file for predictions
+	int threadN = 6;					//number of threads
+	int chunkN = 0;						//number of test cases read at once, 0 - whole test set
+	bool useQS = false;					//use QuickScorer for cases without missing values
 
 	TrainInfo ti;
 
@@ -67,55 +139,68 @@ int main(int argc, char* argv[])
 			else
 				throw INPUT_ERR;
 		}
+		else if(!args[argNo].compare("-h"))
+#ifndef _WIN32 
+			threadN = atoiExt(argv[argNo + 1]);
+#else
+			throw WIN_ERR;
+#endif
+		else if(!args[argNo].compare("-chunk"))
+			chunkN = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-qs"))
+		{
+			if(!args[argNo + 1].compare("on"))
+				useQS = true;
+			else if(!args[argNo + 1].compare("off"))
+				useQS = false;
+			else
+				throw INPUT_ERR;
+		}
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
 		else
 			throw INPUT_ERR;
 	}
 
-	if(!(hasTest && hasAttr))
+	if(!(hasTest && hasAttr) || (chunkN < 0))
 		throw INPUT_ERR;
 
-//2. Load data
-	INDdata data(ti.trainFName.c_str(), ti.validFName.c_str(), ti.testFName.c_str(), 
+//2. Load data. In the streaming mode the test set is read later, chunk by chunk
+	INDdata data(ti.trainFName.c_str(), ti.validFName.c_str(), (chunkN > 0) ? "" : ti.testFName.c_str(), 
 				 ti.attrFName.c_str());
 	CGrove::setData(data);
 	CTreeNode::setData(data);
 
-//3. Open model file, read its header
-	fstream fmodel(modelFName.c_str(), ios_base::binary | ios_base::in);
-	fmodel.read((char*) &ti.mode, sizeof(enum AG_TRAIN_MODE));
-	if(ti.mode == FAST)
-	{//skip information about fast training - it is not used in this command
-		int dirN = 0;
-		fmodel.read((char*) &dirN, sizeof(int));
-		bool dirStub = false;
-		for(int dirNo = 0; dirNo < dirN; dirNo++)
-			fmodel.read((char*) &dirStub, sizeof(bool));
+//4. Load models, get predictions. A model file of version 2 is mapped into memory, 
+//groves of a model file of version 1 are loaded and compiled one by one
+	CCompiledModel model;	//all groves of the model in flat arrays
+	if(LogStream::doOut)
+		cout << "Calculating predictions " << endl;
+	ti.bagN = loadModel(modelFName, data, ti, model, NULL, LogStream::doOut);
+	if(useQS)
+	{
+		model.useQuickScorer();
+		clog << "QuickScorer is used for " << model.getQSTreeN() << " trees\n";
+	}
+
+	//get bagged predictions of the ensemble, blocks of cases are processed in parallel
+#ifndef _WIN32
+	TThreadPool pool(threadN);
+	CCompiledModel::setPool(&pool);
+#endif
+	if(chunkN > 0)
+	{
+		streamPredict(data, model, ti, predFName, chunkN);
+		return 0;
 	}
-	fmodel.read((char*) &ti.maxTiGN, sizeof(int));
-	fmodel.read((char*) &ti.minAlpha, sizeof(double));
-	if(fmodel.fail() || (ti.maxTiGN < 1))
-		throw MODEL_ERR;
 
-//4. Load models, get predictions	
 	doublev testTar;
 	int testN = data.getTargets(testTar, TEST);
 	doublev preds(testN, 0);
-
-	ti.bagN = 0;
-	cout << "Calculating predictions " << endl;
-	while(fmodel.peek() != char_traits<char>::eof())
-	{//load next Grove in the ensemble 
-		ti.bagN++;
-		cout << "Iteration " << ti.bagN << endl;
-		CGrove grove(ti.minAlpha, ti.maxTiGN);
-		grove.load(fmodel);
-
-		//get predictions, add them to predictions of previous models
-		for(int itemNo = 0; itemNo < testN; itemNo++)
-			preds[itemNo] += grove.predict(itemNo, TEST);
-	}
-
-	//get bagged predictions of the ensemble
+	vector<const float*> rows(testN);
+	for(int itemNo = 0; itemNo < testN; itemNo++)
+		rows[itemNo] = data.getRow(itemNo, TEST);
+	model.predictBatch(rows, preds);
 	for(int itemNo = 0; itemNo < testN; itemNo++)
 		preds[itemNo] /= ti.bagN;
 	
@@ -150,7 +235,13 @@ int main(int argc, char* argv[])
 		{
 			case INPUT_ERR:
 				errlog << "Usage: ag_predict -p _test_set_ -r _attr_file_name_ "
-					<< "[-m _model_file_name_] [-o _output_file_name_] [-c rms|roc]\n";
+					<< "[-m _model_file_name_] [-o _output_file_name_] [-c rms|roc]\n\t[-h _threads_] [-chunk _chunk_size_] [-qs on|off]\n\t[-wd _work_dir_]\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
+				break;
+			case WIN_ERR:
+				errlog << "Input error: TreeExtra currently does not support multithreading for Windows.\n";
 				break;
 			default:
 				throw err;
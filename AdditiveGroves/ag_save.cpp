@@ -5,17 +5,19 @@
 #include "ag_functions.h"
 #include "functions.h"
 #include "Grove.h"
+#include "GroveStore.h"
 #include "LogStream.h"
 #include "ErrLogStream.h"
 #include "ag_definitions.h"
 
 #include <errno.h>
 
-//ag_save [-m _model_file_name_] [-a _alpha_value] [-n _N_value_] [-b _bagging_iterations_]
+//ag_save [-m _model_file_name_] [-a _alpha_value] [-n _N_value_] [-b _bagging_iterations_] [-wd _work_dir_]
 int main(int argc, char* argv[])
 {	 
 	try{
-	//0. Set log file
+	//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
 	LogStream clog;
 	clog << "\n-----\nag_save ";
 	for(int argNo = 1; argNo < argc; argNo++)
@@ -32,7 +34,7 @@ int main(int argc, char* argv[])
 	
 	//read values of Groves parameters that produced best results
 	fstream fbest;
-	fbest.open("./AGTemp/best.txt", ios_base::in); 
+	fbest.open(workPath("AGTemp/best.txt").c_str(), ios_base::in); 
 	fbest >> dStub >> saveTiGN >> saveAlpha >> saveBagN >> itemN;
 	if(fbest.fail())
 		throw TEMP_ERR;
@@ -40,7 +42,7 @@ int main(int argc, char* argv[])
 
 	//read values of parameters for which models are trained
 	fstream fparam;	
-	fparam.open("./AGTemp/params.txt", ios_base::in); 
+	fparam.open(workPath("AGTemp/params.txt").c_str(), ios_base::in); 
 	string modeStr, attrFName;
 	fparam >> iStub >> sStub >> sStub >> ti.attrFName >> ti.minAlpha >> ti.maxTiGN 
 		>> ti.bagN >> modeStr;	
@@ -82,6 +84,8 @@ int main(int argc, char* argv[])
 			if(modelFName.empty())
 				throw EMPTY_MODEL_NAME_ERR;
 		}
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
 		else
 			throw INPUT_ERR;
 	}//end for(int argNo = 1; argNo < argc; argNo += 2)
@@ -114,6 +118,27 @@ int main(int argc, char* argv[])
 	int saveTiGNNo = getTiGNN(saveTiGN) - 1;
 	boolv dir; //path on the parameter grid
 
+	//if the grid was pruned, the model might have less groves than the rest of the grid
+	if(isPruned(workPath("")))
+	{
+		intvv pruned(tigNN, intv(alphaN, 0)); 
+		fstream fpruned;	
+		fpruned.open(workPath("AGTemp/pruned.txt").c_str(), ios_base::in); 
+		for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+			for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
+				fpruned >> pruned[tigNNo][alphaNo];
+		if(fpruned.fail())
+			throw TEMP_ERR;
+		fpruned.close();
+
+		int savePrunedN = pruned[saveTiGNNo][saveAlphaNo];
+		if(savePrunedN && (saveBagN > savePrunedN))
+		{
+			clog << "The model was pruned after " << savePrunedN << " bagging iterations.\n";
+			throw PRUNE_ERR;
+		}
+	}
+
 	clog << "Alpha = " << saveAlpha << "\nN = " << saveTiGN << "\n" 
 		<< saveBagN << " bagging iterations" << "\n\n";
 
@@ -129,7 +154,7 @@ int main(int argc, char* argv[])
 		//outer array: column (by TiGN)
 		//middle array: row	(by alpha)
 		fstream fdir;	
-		fdir.open("./AGTemp/dir.txt", ios_base::in); 
+		fdir.open(workPath("AGTemp/dir.txt").c_str(), ios_base::in); 
 		for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
 			for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
 				fdir >> dirMx[tigNNo][alphaNo];
@@ -154,6 +179,10 @@ int main(int argc, char* argv[])
 	}
 
 	//5. Save the model
+	CGroveStore store(workPath("AGTemp"));	//groves of the whole grid
+	if(store.getBagN(saveAlpha, saveTiGN) < saveBagN)
+		throw TEMP_ERR;
+
 	fstream fmodel(modelFName.c_str(), ios_base::binary | ios_base::out);
 	//save ti.mode, dir (if ti.mode==FAST) and saveTiGN
 	fmodel.write((char*) &ti.mode, sizeof(enum AG_TRAIN_MODE));
@@ -169,25 +198,10 @@ int main(int argc, char* argv[])
 	}
 	fmodel.write((char*) &saveTiGN, sizeof(int));
 	fmodel.write((char*) &saveAlpha, sizeof(double));
+
+	//copy saveBagN groves from the store to the output file, the format is the same
+	store.copy(fmodel, saveAlpha, saveTiGN, saveBagN);
 	fmodel.close();
-	
-	//generate the title of the file with the trees
-	const int buflen = 1024;
-	char buf[buflen]; 
-	string treesFName = string("./AGTemp/ag.a.") 
-						+ alphaToStr(saveAlpha)
-						+ ".n." 
-						+ itoa(saveTiGN, 10) 
-						+ ".tmp";
-	//read saveBagN groves and save them to the output file
-	fstream ftrees(treesFName.c_str(), ios_base::binary | ios_base::in);
-	for(int groveNo = 0; groveNo < saveBagN; groveNo++)
-	{
-		CGrove grove(saveAlpha, saveTiGN);
-		grove.load(ftrees);
-		grove.save(modelFName.c_str()); 
-	}
-	ftrees.close();
 
 	}catch(TE_ERROR err){
 		te_errMsg((TE_ERROR)err);
@@ -198,7 +212,10 @@ int main(int argc, char* argv[])
 		{
 			case INPUT_ERR:
 				errlog << "Usage: ag_save [-m _output_file_name_] [-a _alpha_value_] [-n _N_value_] " 
-					<< "[-b _bagging_iterations_]\n";
+					<< "[-b _bagging_iterations_] [-wd _work_dir_]\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
 				break;
 			case TEMP_ERR:
 				errlog << "Error: temporary files from previous runs of train/expand "
@@ -215,6 +232,10 @@ int main(int argc, char* argv[])
 				errlog << "Input error: number of bagging iterations is greater than "
 					<< "in the last run of train/expand.\n";
 				break;
+			case PRUNE_ERR:
+				errlog << "Input error: number of bagging iterations is greater than "
+					<< "the number of iterations this model was trained for before pruning.\n";
+				break;
 			default:
 				throw err;
 		}
@@ -0,0 +1,481 @@
+//Additive Groves / ag_serve.cpp: main function of executable ag_serve
+//
+//(c) Daria Sorokina
+
+#include "Grove.h"
+#include "ag_functions.h"
+#include "TrainInfo.h"
+#include "LogStream.h"
+#include "ErrLogStream.h"
+#include "functions.h"
+#include "ag_definitions.h"
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+#include <errno.h>
+#include <algorithm>
+
+//number of latest requests used to calculate latency percentiles
+#define LATENCY_N 10000
+
+#ifndef _WIN32
+//scoring request: all complete lines received from a client at once
+struct ServeRequest
+{
+	floatvv rows;		//attribute values of the cases
+	doublev preds;		//predictions, filled by the scoring thread
+	bool done;			//predictions are ready
+};
+
+//data shared by all threads of the server
+struct ServeState
+{
+	INDdata* pData;				//used to parse rows
+	CCompiledModel* pModel;		//model, loaded once
+	int bagN;					//number of groves in the model
+
+	TCondition queueCond;		//protects the queue and signals new requests
+	vector<ServeRequest*> queue;	//requests waiting for the scoring thread
+	bool stopScoring;			//the scoring thread should finish
+	TCondition doneCond;		//signals scored requests
+
+	TMutex statMutex;			//protects statistics
+	doublev latencies;			//latencies of the latest requests in microseconds, ring buffer
+	int requestN;				//number of scoring requests
+	int rowN;					//number of scored cases
+	int batchN;					//number of batches scored by the scoring thread
+};
+
+//data passed to a connection thread
+struct ConnInfo
+{
+	ServeState* pState;
+	int fd;			//connected socket
+};
+
+//set by the signal handler when the server should stop
+volatile sig_atomic_t stopServer = 0;
+
+void onStop(int)
+{
+	stopServer = 1;
+}
+
+//starts a detached thread that does not receive termination signals, they are handled by the main thread.
+//Returns false if the thread could not be created
+bool startThread(void* (*threadFunc)(void*), void* param, pthread_t* pThread = NULL)
+{
+	sigset_t stopSigs, oldSigs;
+	sigemptyset(&stopSigs);
+	sigaddset(&stopSigs, SIGINT);
+	sigaddset(&stopSigs, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stopSigs, &oldSigs);
+
+	pthread_t thread;
+	bool started = (pthread_create(&thread, NULL, threadFunc, param) == 0);
+	if(started)
+	{
+		if(pThread)
+			*pThread = thread;
+		else
+			pthread_detach(thread);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &oldSigs, NULL);
+	return started;
+}
+
+//returns statistics of the server as a single line of text
+string getStats(ServeState& st)
+{
+	st.statMutex.Lock();
+	doublev latencies = st.latencies;
+	ostringstream stats;
+	stats << "requests: " << st.requestN << ", rows: " << st.rowN << ", batches: " << st.batchN;
+	st.statMutex.Unlock();
+
+	int latN = (int)latencies.size();
+	if(latN > 0)
+	{
+		sort(latencies.begin(), latencies.end());
+		stats << ", p50: " << latencies[(latN - 1) / 2] << " us, p99: " << latencies[(latN - 1) * 99 / 100] << " us";
+	}
+	return stats.str();
+}
+
+//scoring thread: takes all waiting requests, scores them together, wakes up their connection threads.
+//Requests of different clients that arrive while a batch is being scored go to the same next batch
+void* scoreRequests(void* param)
+{
+	ServeState& st = *(ServeState*)param;
+	vector<ServeRequest*> batch;
+	vector<const float*> rows;
+	doublev preds;
+
+	while(true)
+	{
+		st.queueCond.Lock();
+		while(st.queue.empty() && !st.stopScoring)
+			st.queueCond.Wait();
+		if(st.queue.empty())
+		{
+			st.queueCond.Unlock();
+			break;
+		}
+		batch.swap(st.queue);
+		st.queueCond.Unlock();
+
+		rows.clear();
+		for(int reqNo = 0; reqNo < (int)batch.size(); reqNo++)
+			for(int rowNo = 0; rowNo < (int)batch[reqNo]->rows.size(); rowNo++)
+				rows.push_back(&batch[reqNo]->rows[rowNo][0]);
+		st.pModel->predictBatch(rows, preds);
+
+		st.doneCond.Lock();
+		int predNo = 0;
+		for(int reqNo = 0; reqNo < (int)batch.size(); reqNo++)
+		{
+			ServeRequest& req = *batch[reqNo];
+			req.preds.resize(req.rows.size());
+			for(int rowNo = 0; rowNo < (int)req.rows.size(); rowNo++)
+				req.preds[rowNo] = preds[predNo++] / st.bagN;
+			req.done = true;
+		}
+		st.doneCond.Unlock();
+		st.doneCond.Broadcast();
+
+		st.statMutex.Lock();
+		st.batchN++;
+		st.statMutex.Unlock();
+		batch.clear();
+	}
+	return NULL;
+}
+
+//writes the whole buffer into a socket, returns false if the client is gone
+bool writeAll(int fd, const string& buf)
+{
+	size_t doneN = 0;
+	while(doneN < buf.size())
+	{
+		ssize_t writeN = write(fd, buf.data() + doneN, buf.size() - doneN);
+		if(writeN < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		doneN += writeN;
+	}
+	return true;
+}
+
+//connection thread: reads lines from a client, replies with one line for every line received.
+//A line with a case gets its prediction or "error", the line "stats" gets statistics of the server
+void* serveClient(void* param)
+{
+	ConnInfo ci = *(ConnInfo*)param;
+	delete (ConnInfo*)param;
+	ServeState& st = *ci.pState;
+
+	string input;		//received data that is not processed yet
+	char readBuf[65536];
+	while(true)
+	{
+		ssize_t readN = read(ci.fd, readBuf, sizeof(readBuf));
+		if(readN < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		if(readN == 0)
+			break;
+		input.append(readBuf, readN);
+
+		string::size_type endPos = input.rfind('\n');
+		if(endPos == string::npos)
+		{
+			if(input.size() >= LINE_LEN)
+				break;	//too long line
+			continue;
+		}
+		double startTime = getTime();
+
+		//parse all complete lines
+		ServeRequest req;
+		req.done = false;
+		intv replyTypes;	//for every line: number of the case in req, -1 - error, -2 - statistics
+		string::size_type lineStart = 0;
+		while(lineStart <= endPos)
+		{
+			string::size_type lineEnd = input.find('\n', lineStart);
+			string line = input.substr(lineStart, lineEnd - lineStart);
+			lineStart = lineEnd + 1;
+			if(!line.empty() && (line[line.size() - 1] == '\r'))
+				line.erase(line.size() - 1);
+			if(line.empty())
+				continue;
+
+			if(!line.compare("stats"))
+			{
+				replyTypes.push_back(-2);
+				continue;
+			}
+			floatv row;
+			try {
+				if(line.size() >= LINE_LEN)
+					throw LONG_LINE_ERR;
+				st.pData->parseRow(&line[0], (streamsize)line.size(), row);
+			} catch (TE_ERROR) {
+				replyTypes.push_back(-1);
+				continue;
+			}
+			replyTypes.push_back((int)req.rows.size());
+			req.rows.push_back(row);
+		}
+		input.erase(0, endPos + 1);
+
+		//pass cases to the scoring thread, wait for predictions
+		int rowN = (int)req.rows.size();
+		if(rowN > 0)
+		{
+			st.queueCond.Lock();
+			st.queue.push_back(&req);
+			st.queueCond.Unlock();
+			st.queueCond.Signal();
+
+			st.doneCond.Lock();
+			while(!req.done)
+				st.doneCond.Wait();
+			st.doneCond.Unlock();
+		}
+
+		ostringstream reply;
+		for(int lineNo = 0; lineNo < (int)replyTypes.size(); lineNo++)
+			if(replyTypes[lineNo] >= 0)
+				reply << req.preds[replyTypes[lineNo]] << "\n";
+			else if(replyTypes[lineNo] == -1)
+				reply << "error\n";
+			else
+				reply << getStats(st) << "\n";
+		bool sent = writeAll(ci.fd, reply.str());
+
+		if(rowN > 0)
+		{
+			st.statMutex.Lock();
+			double latency = (getTime() - startTime) * 1e6;
+			if((int)st.latencies.size() < LATENCY_N)
+				st.latencies.push_back(latency);
+			else
+				st.latencies[st.requestN % LATENCY_N] = latency;
+			st.requestN++;
+			st.rowN += rowN;
+			st.statMutex.Unlock();
+		}
+		if(!sent)
+			break;
+	}
+	close(ci.fd);
+	return NULL;
+}
+#endif
+
+//ag_serve -r _attr_file_ [-m _model_file_name_] [-s _socket_file_name_] [-h _threads_] [-wd _work_dir_]
+int main(int argc, char* argv[])
+{
+	try{
+	//0. Set working directory and log file
+	setWorkDir(getWorkDir(argc, argv));
+	LogStream clog;
+	clog << "\n-----\nag_serve ";
+	for(int argNo = 1; argNo < argc; argNo++)
+		clog << argv[argNo] << " ";
+	clog << "\n\n";
+
+	//1. Set default values of parameters
+	string modelFName = "model.bin";		//name of the input file for the model
+	string socketFName = "ag_serve.sock";	//name of the unix domain socket
+	int threadN = 6;						//number of threads used to score large batches
+
+	TrainInfo ti;
+
+	//2. Set parameters from command line
+	//check that the number of arguments is even (flags + value pairs)
+	if(argc % 2 == 0)
+		throw INPUT_ERR;
+	//convert input parameters to string from char*
+	stringv args(argc);
+	for(int argNo = 0; argNo < argc; argNo++)
+		args[argNo] = string(argv[argNo]);
+
+	//parse and save input parameters
+	//indicators of presence of required flags in the input
+	bool hasAttr = false;
+
+	for(int argNo = 1; argNo < argc; argNo += 2)
+	{
+		if(!args[argNo].compare("-m"))
+			modelFName = args[argNo + 1];
+		else if(!args[argNo].compare("-s"))
+			socketFName = args[argNo + 1];
+		else if(!args[argNo].compare("-r"))
+		{
+			ti.attrFName = args[argNo + 1];
+			hasAttr = true;
+		}
+		else if(!args[argNo].compare("-h"))
+			threadN = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
+		else
+			throw INPUT_ERR;
+	}
+
+	if(!hasAttr)
+		throw INPUT_ERR;
+
+#ifdef _WIN32
+	throw WIN_ERR;
+#else
+//2. Load attribute file, it is used to parse cases
+	INDdata data("", "", "", ti.attrFName.c_str());
+	CGrove::setData(data);
+	CTreeNode::setData(data);
+
+//3. Load the model, a model file of version 2 is mapped into memory
+	CCompiledModel model;	//all groves of the model in flat arrays
+	ti.bagN = loadModel(modelFName, data, ti, model);
+	clog << "Loaded " << ti.bagN << " groves, " << model.getNodeN() << " nodes\n";
+
+	TThreadPool pool(threadN);
+	CCompiledModel::setPool(&pool);
+
+//4. Open the socket
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if(socketFName.size() >= sizeof(addr.sun_path))
+		throw SOCKET_ERR;
+	strcpy(addr.sun_path, socketFName.c_str());
+
+	int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listenFd < 0)
+		throw SOCKET_ERR;
+	unlink(socketFName.c_str());
+	if((bind(listenFd, (struct sockaddr*) &addr, sizeof(addr)) != 0) || (listen(listenFd, 64) != 0))
+		throw SOCKET_ERR;
+
+	//SIGINT and SIGTERM stop the server, accept is interrupted by them
+	struct sigaction stopAction;
+	memset(&stopAction, 0, sizeof(stopAction));
+	stopAction.sa_handler = onStop;
+	sigemptyset(&stopAction.sa_mask);
+	sigaction(SIGINT, &stopAction, NULL);
+	sigaction(SIGTERM, &stopAction, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+//5. Serve clients: a thread per connection, one scoring thread for all of them
+	ServeState st;
+	st.pData = &data;
+	st.pModel = &model;
+	st.bagN = ti.bagN;
+	st.stopScoring = false;
+	st.requestN = 0;
+	st.rowN = 0;
+	st.batchN = 0;
+	pthread_t scoreThread;
+	if(!startThread(scoreRequests, &st, &scoreThread))
+		throw SOCKET_ERR;
+
+	clog << "Listening on " << socketFName << "\n";
+	clog.flush();
+	while(!stopServer)
+	{
+		int fd = accept(listenFd, NULL, NULL);
+		if(fd < 0)
+		{
+			int acceptErr = errno;
+			if(acceptErr == EINTR)
+				continue;
+			//only a broken listening socket stops the server, other errors concern a single connection
+			if((acceptErr == EBADF) || (acceptErr == EINVAL) || (acceptErr == ENOTSOCK))
+				throw SOCKET_ERR;
+			string errstr = strerror(acceptErr);
+			ErrLogStream errlog;
+			errlog << "Error: cannot accept a connection: " << errstr << "\n";
+			//out of file descriptors or memory, give connections in progress time to finish
+			if((acceptErr == EMFILE) || (acceptErr == ENFILE) || (acceptErr == ENOBUFS) || (acceptErr == ENOMEM))
+				usleep(100000);
+			continue;
+		}
+		ConnInfo* pCI = new ConnInfo;
+		pCI->pState = &st;
+		pCI->fd = fd;
+		if(!startThread(serveClient, pCI))
+		{
+			close(fd);
+			delete pCI;
+			ErrLogStream errlog;
+			errlog << "Error: cannot start a thread for a connection, it is closed.\n";
+		}
+	}
+
+//6. Stop: finish scoring waiting requests, output statistics
+	close(listenFd);
+	unlink(socketFName.c_str());
+	st.queueCond.Lock();
+	st.stopScoring = true;
+	st.queueCond.Unlock();
+	st.queueCond.Signal();
+	pthread_join(scoreThread, NULL);
+
+	clog << "\nServer stopped. " << getStats(st) << "\n";
+	//connection threads can still be waiting for their clients, so the shared objects are not destroyed
+	exit(0);
+#endif
+
+	}catch(TE_ERROR err){
+		te_errMsg((TE_ERROR)err);
+		return 1;
+	}catch(AG_ERROR err){
+		ErrLogStream errlog;
+		switch(err)
+		{
+			case INPUT_ERR:
+				errlog << "Usage: ag_serve -r _attr_file_name_ [-m _model_file_name_] [-s _socket_file_name_] "
+					<< "[-h _threads_]\n\t[-wd _work_dir_]\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory does not exist.\n";
+				break;
+			case WIN_ERR:
+				errlog << "Input error: ag_serve currently does not support Windows.\n";
+				break;
+			case SOCKET_ERR:
+				errlog << "Error: the socket cannot be opened.\n";
+				break;
+			default:
+				throw err;
+		}
+		return 1;
+	}catch(exception &e){
+		ErrLogStream errlog;
+		string errstr(e.what());
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}catch(...){
+		string errstr = strerror(errno);
+		ErrLogStream errlog;
+		errlog << "Error: " << errstr << "\n";
+		return 1;
+	}
+	return 0;
+}
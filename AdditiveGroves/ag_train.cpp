@@ -6,6 +6,7 @@
 #include "functions.h"
 #include "ag_functions.h"
 #include "Grove.h"
+#include "GroveStore.h"
 #include "LogStream.h"
 #include "ErrLogStream.h"
 
@@ -17,22 +18,300 @@
 #include <windows.h>
 #endif
 
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
 #include <errno.h>
 
+//the neighbor(s) a grid cell is initialized from
+enum CELL_FROM
+{
+	FROM_LEFT,		//left neighbor: smaller alpha, same tigN
+	FROM_BOTTOM,	//bottom neighbor: same alpha, smaller tigN
+	FROM_BOTH		//both neighbors are tried, the best grove wins
+};
+
+//Data of a single bagging iteration shared by all cells of the (alpha, tigN) grid
+struct GridInfo
+{
+	GridInfo(TrainInfo& ti_in, int tigNN, doublevv& dir_in, doublevv& dirStat_in, 
+			doublevvv& rmsV_in, doublevvv& rocV_in, doublevvv& predsumsV_in, doublev& validTar_in):
+		ti(ti_in), dir(dir_in), dirStat(dirStat_in), rmsV(rmsV_in), rocV(rocV_in), predsumsV(predsumsV_in), 
+		validTar(validTar_in), bagNo(0), 
+		roundsV(tigNN, doublev(dir_in[0].size(), 0)), convN(tigNN, doublev(dir_in[0].size(), 0))
+	{}
+
+	TrainInfo& ti;
+	doublevv& dir;			//direction of initialization, see main()
+	doublevv& dirStat;		//statistics on direction of initialization
+	doublevvv& rmsV;		//rms surface
+	doublevvv& rocV;		//roc surface
+	doublevvv& predsumsV;	//sums of predictions on the validation set
+	doublev& validTar;		//validation set targets
+	int bagNo;				//current bagging iteration
+
+	floatvvv sinpreds;		//predictions of single trees in the running column of groves
+	doublevv jointpreds;	//predictions of groves in the running column
+
+	doublevv roundsV;		//statistics: total number of rounds of grove rebuilding in every cell
+	doublevv convN;			//statistics: number of groves converged in every cell
+};
+
+//Information required for training a single cell of the grid
+struct CellInfo
+{
+	GridInfo* pGrid;
+	int alphaNo;
+	int tigNNo;
+	CELL_FROM from;			//which neighbor(s) the grove is initialized from
+	BagInfo bag;			//bag of train data used for this cell
+	floatvv sinpreds2;		//copy of single trees predictions of the bottom neighbor
+	doublev jointpreds2;	//copy of predictions of the bottom neighbor
+	int allocN;				//statistics: allocations of working buffers in groves
+	int rebuildN;			//statistics: tree rebuilds in groves
+	bool pruned;			//the cell is pruned, it is trained only as a starting point for its neighbors
+	unsigned int seed;		//seed for random choices inside the cell, drawn in the main thread
+	string groveBuf;		//the winning grove saved into memory, the main thread adds it to the grove store
+};
+
+//returns memory (in bytes) taken by train set predictions of live columns and copies of bottom neighbors
+double predsMemory(GridInfo& gi, vector<CellInfo>& cells)
+{
+	double floatN = 0;	//number of stored single tree predictions
+	double doubleN = 0;	//number of stored grove predictions
+	for(int tigNNo = 0; tigNNo < (int)gi.sinpreds.size(); tigNNo++)
+	{
+		for(int treeNo = 0; treeNo < (int)gi.sinpreds[tigNNo].size(); treeNo++)
+			floatN += gi.sinpreds[tigNNo][treeNo].size();
+		doubleN += gi.jointpreds[tigNNo].size();
+	}
+	for(int cellNo = 0; cellNo < (int)cells.size(); cellNo++)
+	{
+		for(int treeNo = 0; treeNo < (int)cells[cellNo].sinpreds2.size(); treeNo++)
+			floatN += cells[cellNo].sinpreds2[treeNo].size();
+		doubleN += cells[cellNo].jointpreds2.size();
+	}
+	return floatN * sizeof(float) + doubleN * sizeof(double);
+}
+
+//decides which neighbor(s) the cell is initialized from on the given bagging iteration
+CELL_FROM cellFrom(TrainInfo& ti, doublevv& dir, int bagNo, int tigNNo, int alphaNo)
+{
+	if((tigNNo == 0)  //bottom row
+		|| (ti.mode == LAYERED)	//layered training style				
+		|| ((ti.mode == FAST) && (bagNo > 0) && (dir[tigNNo][alphaNo] == 0))) //fixed direction
+		return FROM_LEFT;
+	else if((alphaNo == 0) || (dir[tigNNo][alphaNo] == 1))	//direction fixed upwards
+		return FROM_BOTTOM;
+	else
+		return FROM_BOTH;
+}
+
+//Trains the grove in a single (alpha, tigN) cell of the grid, saves it and evaluates it on the validation set
+void trainCell(CellInfo& cell)
+{
+	GridInfo& gi = *cell.pGrid;
+	TrainInfo& ti = gi.ti;
+	int alphaNo = cell.alphaNo;
+	int tigNNo = cell.tigNNo;
+	int bagNo = gi.bagNo;
+	int alphaN = (int)gi.rmsV[tigNNo].size();
+
+	double alpha;
+	if(alphaNo < alphaN - 1)
+		alpha = alphaVal(alphaNo);
+	else	//this is a special case because minAlpha can be zero
+		alpha = ti.minAlpha;
+
+	int tigN = tigVal(tigNNo);	//number of trees in the current grove
+	CGrove leftGrove(alpha, tigN); //(alpha, tigN) grove grown from the left neighbor
+	CGrove bottomGrove(alpha, tigN); //(alpha, tigN) grove grown from the bottom neighbor
+	leftGrove.setBag(cell.bag);
+	bottomGrove.setBag(cell.bag);
+	leftGrove.setSeed(cell.seed);
+	bottomGrove.setSeed(mix32(cell.seed));
+	CGrove* winGrove = &leftGrove; //better of the two groves
+
+	//note: grove from left is automatically ready for further use,
+	//	but when grove from below is needed instead, it requires extra effort 
+	// (update winGrove, sinpreds, jointpreds)
+	if(cell.from == FROM_LEFT)
+		leftGrove.converge(gi.sinpreds[tigNNo], gi.jointpreds[tigNNo]);
+	else if(cell.from == FROM_BOTTOM)
+	{//build from lower neighbour 
+		gi.sinpreds[tigNNo].swap(cell.sinpreds2);
+		gi.jointpreds[tigNNo].swap(cell.jointpreds2);
+		bottomGrove.converge(gi.sinpreds[tigNNo], gi.jointpreds[tigNNo]);
+		winGrove = &bottomGrove;
+		if((ti.mode == FAST) && (bagNo == 0))	
+			gi.dir[tigNNo][alphaNo] = 1;	//set direction upwards
+		gi.dirStat[tigNNo][alphaNo] += 1;
+	}
+	else
+	{//build both groves, compare performances on train and oob data
+		ddpair rmse_l = leftGrove.converge(gi.sinpreds[tigNNo], gi.jointpreds[tigNNo]);
+		ddpair rmse_b = bottomGrove.converge(cell.sinpreds2, cell.jointpreds2);
+
+		if((rmse_b < rmse_l) || ((rmse_b == rmse_l) && (mix32(cell.seed + 1) % 2 == 0)))
+		{//bottom grove is the winning one
+			winGrove = &bottomGrove;
+			gi.sinpreds[tigNNo].swap(cell.sinpreds2);
+			gi.jointpreds[tigNNo].swap(cell.jointpreds2);
+			if((ti.mode == FAST) && (bagNo == 0))	
+				gi.dir[tigNNo][alphaNo] = 1;	//set direction upwards
+			gi.dirStat[tigNNo][alphaNo] += 1;
+		}
+	}
+	cell.allocN = leftGrove.getAllocN() + bottomGrove.getAllocN();
+	gi.roundsV[tigNNo][alphaNo] += leftGrove.getRoundN() + bottomGrove.getRoundN();
+	gi.convN[tigNNo][alphaNo] += (cell.from == FROM_BOTH) ? 2 : 1;
+	cell.rebuildN = leftGrove.getRebuildN() + bottomGrove.getRebuildN();
+
+	if(cell.pruned)
+	{//the grove itself is not a part of the output any more
+		floatvv().swap(cell.sinpreds2);
+		doublev().swap(cell.jointpreds2);
+		cell.bag = BagInfo();
+		return;
+	}
+
+	//save the winning grove into memory, cells of the same diagonal do it in parallel
+	ostringstream fsave;
+	winGrove->save(fsave);
+	cell.groveBuf = fsave.str();
+
+	//generate predictions for validation set
+	int validN = (int)gi.validTar.size();
+	doublev predictions(validN);
+	for(int itemNo = 0; itemNo < validN; itemNo++)
+	{
+		gi.predsumsV[tigNNo][alphaNo][itemNo] += winGrove->predict(itemNo, VALID);
+		predictions[itemNo] = gi.predsumsV[tigNNo][alphaNo][itemNo] / (bagNo + 1);
+	}
+	gi.rmsV[tigNNo][alphaNo][bagNo] = rmse(predictions, gi.validTar);
+	if(!ti.rms)
+		gi.rocV[tigNNo][alphaNo][bagNo] = roc(predictions, gi.validTar);
+
+	//release memory early, the cell object lives until the whole diagonal is finished
+	floatvv().swap(cell.sinpreds2);
+	doublev().swap(cell.jointpreds2);
+	cell.bag = BagInfo();
+}
+
+#ifndef _WIN32
+//job class, trains a grid cell, used for multithreading in unix
+class CCellJob : public TThreadPool::TJob
+{
+public:
+    
+    CCellJob() : TThreadPool::TJob() { }
+    
+    void Run(void* ptr)
+    {
+		trainCell(*(CellInfo*) ptr);
+    }
+};
+#endif
+
+//State of training after a completed bagging iteration that is not kept in GridInfo
+struct CheckpointInfo
+{
+	string signature;	//parameters of the run, training can be resumed only with the same parameters
+	int bagDoneN;		//number of completed bagging iterations
+	int bagN;			//number of bagging iterations, smaller than requested if training stopped early
+	int nextPruneBagN;	//when the next round of pruning happens
+	int groveN;			//number of groves in the grove store
+	int allocN;			//statistics: allocations of working buffers in groves
+	int rebuildN;		//statistics: tree rebuilds in groves
+	double peakMem;		//statistics: peak memory taken by train set predictions
+	double peakFullMem;	//statistics: same if all columns were kept in double precision
+};
+
+//saves the state of training into AGTemp/checkpoint.bin. 
+//The checkpoint is written into a temporary file first, so that a crash does not destroy the previous one
+void saveCheckpoint(CheckpointInfo& ci, GridInfo& gi, intvv& pruned)
+{
+	string fName = workPath("AGTemp/checkpoint.bin");
+	string tmpFName = workPath("AGTemp/checkpoint.tmp");
+	fstream fcheck(tmpFName.c_str(), ios_base::binary | ios_base::out);
+
+	int sigLen = (int)ci.signature.size();
+	fcheck.write((char*) &sigLen, sizeof(int));
+	fcheck.write(ci.signature.data(), sigLen);
+	fcheck.write((char*) &ci.bagDoneN, sizeof(int));
+	fcheck.write((char*) &ci.bagN, sizeof(int));
+	fcheck.write((char*) &ci.nextPruneBagN, sizeof(int));
+	fcheck.write((char*) &ci.groveN, sizeof(int));
+	fcheck.write((char*) &ci.allocN, sizeof(int));
+	fcheck.write((char*) &ci.rebuildN, sizeof(int));
+	fcheck.write((char*) &ci.peakMem, sizeof(double));
+	fcheck.write((char*) &ci.peakFullMem, sizeof(double));
+
+	fcheck << gi.dir << gi.dirStat << gi.roundsV << gi.convN << gi.rmsV << gi.rocV << gi.predsumsV;
+	for(int tigNNo = 0; tigNNo < (int)pruned.size(); tigNNo++)
+		for(int alphaNo = 0; alphaNo < (int)pruned[tigNNo].size(); alphaNo++)
+			fcheck.write((char*) &pruned[tigNNo][alphaNo], sizeof(int));
+
+	fcheck.close();
+	if(fcheck.fail())
+		throw TREE_WRITE_ERR;
+
+#ifdef _WIN32
+	remove(fName.c_str());	//rename does not replace existing files in windows
+#endif
+	if(rename(tmpFName.c_str(), fName.c_str()) != 0)
+		throw TREE_WRITE_ERR;
+}
+
+//loads the state of training from AGTemp/checkpoint.bin. 
+//Returns false if there is no checkpoint or it was made with different parameters
+bool loadCheckpoint(CheckpointInfo& ci, GridInfo& gi, intvv& pruned)
+{
+	string fName = workPath("AGTemp/checkpoint.bin");
+	fstream fcheck(fName.c_str(), ios_base::binary | ios_base::in);
+	if(!fcheck.is_open())
+		return false;
+
+	int sigLen = 0;
+	fcheck.read((char*) &sigLen, sizeof(int));
+	if(fcheck.fail() || (sigLen != (int)ci.signature.size()))
+		return false;
+	string signature(sigLen, ' ');
+	if(sigLen > 0)
+		fcheck.read(&signature[0], sigLen);
+	if(fcheck.fail() || signature.compare(ci.signature))
+		return false;
+
+	fcheck.read((char*) &ci.bagDoneN, sizeof(int));
+	fcheck.read((char*) &ci.bagN, sizeof(int));
+	fcheck.read((char*) &ci.nextPruneBagN, sizeof(int));
+	fcheck.read((char*) &ci.groveN, sizeof(int));
+	fcheck.read((char*) &ci.allocN, sizeof(int));
+	fcheck.read((char*) &ci.rebuildN, sizeof(int));
+	fcheck.read((char*) &ci.peakMem, sizeof(double));
+	fcheck.read((char*) &ci.peakFullMem, sizeof(double));
+
+	fcheck >> gi.dir >> gi.dirStat >> gi.roundsV >> gi.convN >> gi.rmsV >> gi.rocV >> gi.predsumsV;
+	for(int tigNNo = 0; tigNNo < (int)pruned.size(); tigNNo++)
+		for(int alphaNo = 0; alphaNo < (int)pruned[tigNNo].size(); alphaNo++)
+			fcheck.read((char*) &pruned[tigNNo][alphaNo], sizeof(int));
+
+	return !fcheck.fail();
+}
+
+
 
 
 //ag_train -t _train_set_ -v _validation_set_ -r _attr_file_ [-a _alpha_value_] [-n _N_value_] 
-//		[-b _bagging_iterations_] [-s slow|fast|layered] [-c rms|roc] [-i seed]
+//		[-b _bagging_iterations_] [-s slow|fast|layered] [-c rms|roc] [-i seed] [-h _threads_]
+//		[-tol _convergence_threshold_] [-rounds _max_rounds_] [-conv bag|oob] [-stop on|off] 
+//		[-prune _bagging_iterations_] [-resume on|off] [-wd _work_dir_]
 int main(int argc, char* argv[])
 {	
 	try{
-//0. Set log file
+//0. Set working directory
+	setWorkDir(getWorkDir(argc, argv), true);
 	LogStream clog;
-	LogStream::init(true);
-	clog << "\n-----\nag_train ";
-	for(int argNo = 1; argNo < argc; argNo++)
-		clog << argv[argNo] << " ";
-	clog << "\n\n";
 
 //1. Analyze input parameters
 	//convert input parameters to string from char*
@@ -45,6 +324,7 @@ int main(int argc, char* argv[])
 		throw INPUT_ERR;
 
 	TrainInfo ti;
+	bool resume = false;	//continue training from the last checkpoint
 #ifndef _WIN32
 	int threadN = 6;	//number of threads
 #endif
@@ -100,6 +380,41 @@ int main(int argc, char* argv[])
 		}
 		else if(!args[argNo].compare("-i"))
 			ti.seed = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-tol"))
+			ti.convTol = atofExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-rounds"))
+			ti.maxRounds = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-conv"))
+		{
+			if(!args[argNo + 1].compare("bag"))
+				ti.oobStop = false;
+			else if(!args[argNo + 1].compare("oob"))
+				ti.oobStop = true;
+			else
+				throw INPUT_ERR;
+		}
+		else if(!args[argNo].compare("-stop"))
+		{
+			if(!args[argNo + 1].compare("on"))
+				ti.earlyStop = true;
+			else if(!args[argNo + 1].compare("off"))
+				ti.earlyStop = false;
+			else
+				throw INPUT_ERR;
+		}
+		else if(!args[argNo].compare("-prune"))
+			ti.pruneBagN = atoiExt(argv[argNo + 1]);
+		else if(!args[argNo].compare("-resume"))
+		{
+			if(!args[argNo + 1].compare("on"))
+				resume = true;
+			else if(!args[argNo + 1].compare("off"))
+				resume = false;
+			else
+				throw INPUT_ERR;
+		}
+		else if(!args[argNo].compare("-wd"))
+			continue;	//working directory is already set
 		else if(!args[argNo].compare("-h"))
 #ifndef _WIN32 
 			threadN = atoiExt(argv[argNo + 1]);
@@ -119,33 +434,36 @@ int main(int argc, char* argv[])
 	if(ti.maxTiGN < 1)
 		throw TIGN_ERR;
 
-//1.a) delete all temp files from the previous run and create a directory AGTemp
-#ifdef WIN32	//in windows
-	WIN32_FIND_DATA fn;			//structure that will contain the name of file
-	HANDLE hFind;				//current file
-	hFind = FindFirstFile("./AGTemp/*.*", &fn);	//"."	
-	FindNextFile(hFind, &fn);						//".." 
-	//delete all files in the directory
-	while(FindNextFile(hFind, &fn) != 0) 
-	{
-		string fullName = "AGTemp/" + (string)fn.cFileName;
-		DeleteFile(fullName.c_str());
-	} 
-	CreateDirectory("AGTemp", NULL);
-
-#else 
-	system("rm -rf ./AGTemp/");
-	system("mkdir ./AGTemp/");
-#endif
+	if((ti.convTol < 0) || (ti.maxRounds < 0))
+		throw CONV_ERR;
 
+	if(ti.pruneBagN < 0)
+		throw PRUNE_ERR;
 
-//1.b) Initialize random number generator. 
-	srand(ti.seed);
+//1.a) Set log file. A resumed run continues the log of the interrupted one
+	if(!resume)
+		LogStream::init(true);
+	clog << "\n-----\nag_train ";
+	for(int argNo = 1; argNo < argc; argNo++)
+		clog << argv[argNo] << " ";
+	clog << "\n\n";
+
+//1.b) delete all temp files from the previous run and create a directory AGTemp
+	if(!resume)
+		resetTempDir();
+
+	//all groves of the grid are kept in a single indexed file
+	CGroveStore store(workPath("AGTemp"));
+	if(!resume)
+		store.clear();
+
+	//the random number generator is initialized on every bagging iteration, see bagSeed
 
 //2. Load data
 	INDdata data(ti.trainFName.c_str(), ti.validFName.c_str(), ti.testFName.c_str(), ti.attrFName.c_str());
 	CGrove::setData(data);
 	CTreeNode::setData(data);
+	CGrove::setConvergence(ti.convTol, ti.maxRounds, ti.oobStop);
 
 //2.a) Start thread pool
 #ifndef _WIN32
@@ -184,6 +502,7 @@ int main(int argc, char* argv[])
 		clog << "slow mode\n\n";
 	else //if(ti.mode == LAYERED)
 		clog << "layered mode\n\n";
+	logConvergence(ti);
 
 	int alphaN = getAlphaN(ti.minAlpha, itemN); //number of different alpha values
 	int tigNN = getTiGNN(ti.maxTiGN); //number of different tigN values
@@ -212,112 +531,274 @@ int main(int argc, char* argv[])
 	//direction of initialization (1 - up, 0 - right), collects statistics in the slow mode
 	doublevv dirStat(tigNN, doublev(alphaN, 0));
 
+	//grid data shared by all cells
+	GridInfo gi(ti, tigNN, dir, dirStat, rmsV, rocV, predsumsV, validTar);
+
+#ifndef _WIN32
+	//cells on the same antidiagonal of the grid do not depend on each other and are trained in parallel
+	int diagLen = min(alphaN, tigNN);	//max number of cells on a diagonal
+	TThreadPool gridPool(min(threadN, diagLen));
+#endif
+
+	int allocN = 0;		//statistics: allocations of working buffers in groves
+	int rebuildN = 0;	//statistics: tree rebuilds in groves
+	double peakMem = 0;		//statistics: peak memory taken by train set predictions
+	double peakFullMem = 0;	//statistics: same if all columns with maxTiGN trees in double precision were kept
+
+	//successive halving of the grid: after pruneBagN, 2*pruneBagN, 4*pruneBagN, ... bagging iterations 
+	//the worse half of active cells is pruned. Pruned cells are not evaluated and saved any more
+	intvv pruned(tigNN, intv(alphaN, 0));	//bagging iterations after which cells were pruned, 0 - active
+	int nextPruneBagN = ti.pruneBagN;		//when the next round of pruning happens
+
+	//state of training is saved after every bagging iteration
+	CheckpointInfo ci;
+	ostringstream signature;
+	signature << ti.seed << '\n' << ti.trainFName << '\n' << ti.validFName << '\n' << ti.attrFName << '\n' 
+		<< ti.minAlpha << ' ' << ti.maxTiGN << ' ' << ti.bagN << ' ' << ti.mode << ' ' << ti.rms << ' ' 
+		<< ti.convTol << ' ' << ti.maxRounds << ' ' << ti.oobStop << ' ' << ti.earlyStop << ' ' << ti.pruneBagN;
+	ci.signature = signature.str();
+	int startBagNo = 0;
+	if(resume)
+	{
+		if(!loadCheckpoint(ci, gi, pruned))
+			throw RESUME_ERR;
+		store.rollback(ci.groveN);
+		startBagNo = ci.bagDoneN;
+		ti.bagN = ci.bagN;
+		nextPruneBagN = ci.nextPruneBagN;
+		allocN = ci.allocN;
+		rebuildN = ci.rebuildN;
+		peakMem = ci.peakMem;
+		peakFullMem = ci.peakFullMem;
+		clog << "Resuming training after " << startBagNo << " bagging iterations\n\n";
+	}
+
 	//make bags, build trees, collect predictions
-	for(int bagNo = 0; bagNo < ti.bagN; bagNo++)
+	for(int bagNo = startBagNo; bagNo < ti.bagN; bagNo++)
 	{
 		cout << "Iteration " << bagNo + 1 << " out of " << ti.bagN << endl;
+		gi.bagNo = bagNo;
+		srand(bagSeed(ti.seed, bagNo));
+
 		//predictions of single trees in groves on the train set data points
-		doublevvv sinpreds(tigNN, doublevv(ti.maxTiGN, doublev(itemN, 0)));	
+		gi.sinpreds.assign(tigNN, floatvv());	
 		//outer array: running column in surface matrix
-		//middle array: grove (multiple trees)
+		//middle array: grove (multiple trees), tigVal(tigNNo) trees in a column
 		//inner array: predictions by a tree in a grove
 
 		//predictions of groves on the train set data points 
-		doublevv jointpreds(tigNN, doublev(itemN, 0));
+		gi.jointpreds.assign(tigNN, doublev());
 		//outer array: running column in surface matrix
 		//inner array: predictions by the grove
-		//generate a grid of models
-		for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+
+		//a column is allocated when its first cell is trained and freed when it is not needed anymore
+
+		//a cell is trained if it is active or if its grove is a starting point for another trained cell:
+		//its right neighbor is trained from the left or its top neighbor is trained from the bottom
+		boolvv toTrain(tigNN, boolv(alphaN, true));
+		if(ti.pruneBagN > 0)
+			for(int tigNNo = tigNN - 1; tigNNo >= 0; tigNNo--)
+				for(int alphaNo = alphaN - 1; alphaNo >= 0; alphaNo--)
+					toTrain[tigNNo][alphaNo] = (pruned[tigNNo][alphaNo] == 0)
+						|| ((alphaNo < alphaN - 1) && toTrain[tigNNo][alphaNo + 1] 
+							&& (cellFrom(ti, dir, bagNo, tigNNo, alphaNo + 1) != FROM_BOTTOM))
+						|| ((tigNNo < tigNN - 1) && toTrain[tigNNo + 1][alphaNo] 
+							&& (cellFrom(ti, dir, bagNo, tigNNo + 1, alphaNo) != FROM_LEFT));
+
+		//generate a grid of models, one antidiagonal (alphaNo + tigNNo = diagNo) at a time.
+		//Cell (tigNNo, alphaNo) depends only on its left (tigNNo, alphaNo - 1) and 
+		//bottom (tigNNo - 1, alphaNo) neighbors, both of them lie on the previous diagonal
+		for(int diagNo = 0; diagNo < alphaN + tigNN - 1; diagNo++)
 		{
-			double alpha;
-			if(alphaNo < alphaN - 1)
-				alpha = alphaVal(alphaNo);
-			else	//this is a special case because minAlpha can be zero
-				alpha = ti.minAlpha;
+			int firstTiGNNo = max(0, diagNo - alphaN + 1);
+			int lastTiGNNo = min(tigNN - 1, diagNo);
+			cout << "\tBuilding models on diagonal " << diagNo + 1 << " out of " << alphaN + tigNN - 1 << endl;
+
+			//prepare the cells: new bags and copies of bottom neighbors' predictions.
+			//This is done before any cell of the diagonal starts, because cells overwrite predictions 
+			//of their left neighbors, which may be bottom neighbors of other cells on the same diagonal
+			vector<CellInfo> cells;
+			cells.reserve(lastTiGNNo - firstTiGNNo + 1);
+			int copyN = 0;	//number of copies of bottom neighbors
+			for(int tigNNo = firstTiGNNo; tigNNo <= lastTiGNNo; tigNNo++)
+			{
+				if(!toTrain[tigNNo][diagNo - tigNNo])
+					continue;
 
-			cout << "\tBuilding models with alpha = " << alpha << endl;
+				cells.push_back(CellInfo());
+				CellInfo& cell = cells.back();
+				cell.pGrid = &gi;
+				cell.tigNNo = tigNNo;
+				cell.alphaNo = diagNo - tigNNo;
+				cell.pruned = (pruned[tigNNo][cell.alphaNo] != 0);
 
-			//generate a column with the same alpha 
-			for(int tigNNo = 0; tigNNo < tigNN; tigNNo++) 
-			{
 				data.newBag();
-
-				int tigN = tigVal(tigNNo);	//number of trees in the current grove
-				CGrove leftGrove(alpha, tigN); //(alpha, tigN) grove grown from the left neighbor
-				CGrove bottomGrove(alpha, tigN); //(alpha, tigN) grove grown from the bottom neighbor
-				CGrove* winGrove = &leftGrove; //better of the two groves
-
-				//note: grove from left is automatically ready for further use,
-				//	but when grove from below is needed instead, it requires extra effort 
-				// (update winGrove, sinpreds, jointpreds)
-				if((tigNNo == 0)  //bottom row
-					|| (ti.mode == LAYERED)	//layered training style				
-					|| ((ti.mode == FAST) && (bagNo > 0) && (dir[tigNNo][alphaNo] == 0))) //fixed direction
-					//build from left neighbor
-					leftGrove.converge(sinpreds[tigNNo], jointpreds[tigNNo]);
-				else if((alphaNo == 0) || (dir[tigNNo][alphaNo] == 1))	//direction fixed upwards 
-				{//build from lower neighbour 
-					sinpreds[tigNNo] = sinpreds[tigNNo - 1];
-					jointpreds[tigNNo] = jointpreds[tigNNo - 1];
-					bottomGrove.converge(sinpreds[tigNNo], jointpreds[tigNNo]);
-					winGrove = &bottomGrove;
-					if((ti.mode == FAST) && (bagNo == 0))	
-						dir[tigNNo][alphaNo] = 1;	//set direction upwards
-					dirStat[tigNNo][alphaNo] += 1;
-				}
-				else
-				{//build both groves, compare performances on train and oob data
-					doublevv sinpreds2 = sinpreds[tigNNo - 1];
-					doublev jointpreds2 = jointpreds[tigNNo - 1];
-
-					ddpair rmse_l = leftGrove.converge(sinpreds[tigNNo], jointpreds[tigNNo]);
-					ddpair rmse_b = bottomGrove.converge(sinpreds2, jointpreds2);
-
-					if((rmse_b < rmse_l) || ((rmse_b == rmse_l) && (rand()%2 == 0)))
-					{//bottom grove is the winning one
-						winGrove = &bottomGrove;
-						sinpreds[tigNNo] = sinpreds2;
-						jointpreds[tigNNo] = jointpreds2;
-						if((ti.mode == FAST) && (bagNo == 0))	
-							dir[tigNNo][alphaNo] = 1;	//set direction upwards
-						dirStat[tigNNo][alphaNo] += 1;
+				data.getBag(cell.bag);
+				cell.seed = (unsigned int)rand();
+
+				cell.from = cellFrom(ti, dir, bagNo, tigNNo, cell.alphaNo);
+
+				if(cell.from != FROM_LEFT)
+				{//the bottom column is copied only if its right neighbor on this diagonal starts from it as well,
+					//otherwise it is not needed anymore and is taken over by this cell
+					int alphaNo = cell.alphaNo;
+					if((alphaNo < alphaN - 1) && toTrain[tigNNo - 1][alphaNo + 1] 
+						&& (cellFrom(ti, dir, bagNo, tigNNo - 1, alphaNo + 1) != FROM_BOTTOM))
+					{
+						cell.sinpreds2 = gi.sinpreds[tigNNo - 1];
+						cell.jointpreds2 = gi.jointpreds[tigNNo - 1];
+					}
+					else
+					{
+						cell.sinpreds2.swap(gi.sinpreds[tigNNo - 1]);
+						cell.jointpreds2.swap(gi.jointpreds[tigNNo - 1]);
 					}
+					cell.sinpreds2.resize(tigVal(tigNNo), floatv(itemN, 0));	//new trees start empty
+					copyN++;
 				}
-				//add the winning grove to a model file with alpha and tigN values in the name
-				string prefix = string("./AGTemp/ag.a.") 
-									+ alphaToStr(alpha)
-									+ ".n." 
-									+ itoa(tigN, 10);
-				string tempFName = prefix + ".tmp";
-				winGrove->save(tempFName.c_str());
-
-				//generate predictions for validation set
-				doublev predictions(validN);
-				for(int itemNo = 0; itemNo < validN; itemNo++)
+				if((cell.from != FROM_BOTTOM) && gi.sinpreds[tigNNo].empty())
+				{//first cell of the column, starts from an empty grove
+					gi.sinpreds[tigNNo].assign(tigVal(tigNNo), floatv(itemN, 0));
+					gi.jointpreds[tigNNo].assign(itemN, 0);
+				}
+			}
+
+			//the column below the end of the diagonal is not needed anymore
+			if(diagNo >= alphaN)
+			{
+				floatvv().swap(gi.sinpreds[diagNo - alphaN]);
+				doublev().swap(gi.jointpreds[diagNo - alphaN]);
+			}
+
+			peakMem = max(peakMem, predsMemory(gi, cells));
+			peakFullMem = max(peakFullMem, 
+				(double)(tigNN + copyN) * (ti.maxTiGN + 1) * itemN * sizeof(double));
+
+			//train the cells
+			for(int cellNo = 0; cellNo < (int)cells.size(); cellNo++)
+#ifdef _WIN32
+				trainCell(cells[cellNo]);
+#else
+				gridPool.Run(new CCellJob(), &cells[cellNo], true);
+			gridPool.SyncAll();
+#endif
+
+			for(int cellNo = 0; cellNo < (int)cells.size(); cellNo++)
+			{
+				CellInfo& cell = cells[cellNo];
+				allocN += cell.allocN;
+				rebuildN += cell.rebuildN;
+				if(!cell.pruned)
 				{
-					predsumsV[tigNNo][alphaNo][itemNo] += winGrove->predict(itemNo, VALID);
-					predictions[itemNo] = predsumsV[tigNNo][alphaNo][itemNo] / (bagNo + 1);
+					double alpha = (cell.alphaNo < alphaN - 1) ? alphaVal(cell.alphaNo) : ti.minAlpha;
+					store.add(alpha, tigVal(cell.tigNNo), cell.groveBuf);
 				}
-				if(bagNo == ti.bagN - 1)
+			}
+		}//end for(int diagNo = 0; diagNo < alphaN + tigNN - 1; diagNo++)
+
+		//save groves of the whole bagging iteration with a single write
+		store.flush();
+
+		//bagging curves of pruned cells stay flat
+		for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
+			for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+				if(pruned[tigNNo][alphaNo])
 				{
-					string predsFName = prefix + ".preds.txt";
-					fstream fpreds(predsFName.c_str(), ios_base::out);
-					for(int itemNo = 0; itemNo < validN; itemNo++)
-						fpreds << predictions[itemNo] << endl;
-					fpreds.close();
+					rmsV[tigNNo][alphaNo][bagNo] = rmsV[tigNNo][alphaNo][bagNo - 1];
+					if(!ti.rms)
+						rocV[tigNNo][alphaNo][bagNo] = rocV[tigNNo][alphaNo][bagNo - 1];
 				}
-				rmsV[tigNNo][alphaNo][bagNo] = rmse(predictions, validTar);
-				if(!ti.rms)
-					rocV[tigNNo][alphaNo][bagNo] = roc(predictions, validTar);
-			}//end for(int tigNNo = 0; tigNNo < tigNN; tigNNo++) 
-		}//end for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+
+		//pruning: keep the better half of active cells
+		if((bagNo + 1 == nextPruneBagN) && (bagNo < ti.bagN - 1))
+		{
+			doublevvv& surfaceV = ti.rms ? rmsV : rocV;
+			dipairv activeCells;	//performance (the smaller the better) and id of active cells
+			for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
+				for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+					if(pruned[tigNNo][alphaNo] == 0)
+					{
+						double perf = surfaceV[tigNNo][alphaNo][bagNo];
+						activeCells.push_back(dipair(ti.rms ? perf : -perf, tigNNo * alphaN + alphaNo));
+					}
+			sort(activeCells.begin(), activeCells.end());
+			int activeN = (int)activeCells.size();
+			int keepN = (activeN + 1) / 2;
+			for(int cellNo = keepN; cellNo < activeN; cellNo++)
+			{
+				int cellId = activeCells[cellNo].second;
+				pruned[cellId / alphaN][cellId % alphaN] = bagNo + 1;
+			}
+			clog << "Pruning after " << bagNo + 1 << " bagging iterations: " << keepN << " out of " 
+				<< activeN << " models remain active\n\n";
+			nextPruneBagN *= 2;
+		}
+
+		//early stopping: same criterion as the recommendation on more bagging, applied to the current best model.
+		//All groves of this iteration are saved already, so AGTemp stays consistent for ag_expand
+		if(ti.earlyStop && (bagNo < ti.bagN - 1))
+		{
+			int bestTiGNNo, bestAlphaNo;
+			findBest(ti, ti.rms ? rmsV : rocV, bagNo + 1, itemN, bestTiGNNo, bestAlphaNo, 0, 0, &pruned);
+			if(!gridMoreBag(rmsV, bagNo + 1, bestTiGNNo, bestAlphaNo))
+			{
+				clog << "The bagging curve has converged, training stopped after " << bagNo + 1 
+					<< " out of " << ti.bagN << " bagging iterations.\n\n";
+				ti.bagN = bagNo + 1;
+			}
+		}
+
+		ci.bagDoneN = bagNo + 1;
+		ci.bagN = ti.bagN;
+		ci.nextPruneBagN = nextPruneBagN;
+		ci.groveN = store.getGroveN();
+		ci.allocN = allocN;
+		ci.rebuildN = rebuildN;
+		ci.peakMem = peakMem;
+		ci.peakFullMem = peakFullMem;
+		saveCheckpoint(ci, gi, pruned);
 	}// end for(int bagNo = 0; bagNo < ti.bagN; bagNo++)
 
+	//cut bagging curves to the actual number of iterations
+	for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
+		for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+		{
+			rmsV[tigNNo][alphaNo].resize(ti.bagN);
+			if(!ti.rms)
+				rocV[tigNNo][alphaNo].resize(ti.bagN);
+		}
+
+	//save predictions of all models on the validation set
+	for(int tigNNo = 0; tigNNo < tigNN; tigNNo++)
+		for(int alphaNo = 0; alphaNo < alphaN; alphaNo++)
+		{
+			int cellBagN = pruned[tigNNo][alphaNo] ? pruned[tigNNo][alphaNo] : ti.bagN;
+			double alpha = (alphaNo < alphaN - 1) ? alphaVal(alphaNo) : ti.minAlpha;
+			string predsFName = workPath("AGTemp/ag.a.") 
+								+ alphaToStr(alpha)
+								+ ".n." 
+								+ itoa(tigVal(tigNNo), 10)
+								+ ".preds.txt";
+			fstream fpreds(predsFName.c_str(), ios_base::out);
+			for(int itemNo = 0; itemNo < validN; itemNo++)
+				fpreds << predsumsV[tigNNo][alphaNo][itemNo] / cellBagN << endl;
+			fpreds.close();
+		}
+
+	logRounds(ti, gi.roundsV, gi.convN, itemN);
+	clog << "Grove working buffer allocations: " << allocN << " for " << rebuildN << " tree rebuilds\n";
+	clog << "Peak memory for train set predictions: " << peakMem / 1048576 << " MB (" 
+		<< peakFullMem / 1048576 << " MB if all columns are stored in double precision)\n\n";
+
 //4. Output
+	intvv* pPruned = (ti.pruneBagN > 0) ? &pruned : NULL;
 	if(ti.rms)
-		trainOut(ti, dir, rmsV, rmsV, predsumsV, itemN, dirStat);
+		trainOut(ti, dir, rmsV, rmsV, predsumsV, itemN, dirStat, 0, 0, pPruned);
 	else
-		trainOut(ti, dir, rmsV, rocV, predsumsV, itemN, dirStat);
+		trainOut(ti, dir, rmsV, rocV, predsumsV, itemN, dirStat, 0, 0, pPruned);
+
+	//the grid is complete, ag_expand will change AGTemp, so the checkpoint cannot be used anymore
+	remove(workPath("AGTemp/checkpoint.bin").c_str());
 
 	}catch(TE_ERROR err){
 		te_errMsg((TE_ERROR)err);
@@ -329,7 +810,12 @@ int main(int argc, char* argv[])
 			case INPUT_ERR:
 				errlog << "Usage: ag_train -t _train_set_ -v _validation_set_ -r _attr_file_ "
 					<< "[-a _alpha_value_] [-n _N_value_] [-b _bagging_iterations_] [-s slow|fast|layered] " 
-					<< "[-i _init_random_] [-c rms|roc]\n";
+					<< "[-i _init_random_] [-c rms|roc] [-h _threads_]\n"
+					<< "\t[-tol _convergence_threshold_] [-rounds _max_rounds_] [-conv bag|oob] [-stop on|off]\n"
+					<< "\t[-prune _bagging_iterations_] [-resume on|off] [-wd _work_dir_]\n";
+				break;
+			case WORKDIR_ERR:
+				errlog << "Error: working directory cannot be created.\n";
 				break;
 			case ALPHA_ERR:
 				errlog << "Input error: alpha value is out of [0;1] range.\n";
@@ -340,6 +826,16 @@ int main(int argc, char* argv[])
 			case WIN_ERR:
 				errlog << "Input error: TreeExtra currently does not support multithreading for Windows.\n"; 
 				break;
+			case CONV_ERR:
+				errlog << "Input error: convergence threshold or max number of rounds is negative.\n"; 
+				break;
+			case PRUNE_ERR:
+				errlog << "Input error: number of bagging iterations before pruning is negative.\n"; 
+				break;
+			case RESUME_ERR:
+				errlog << "Error: no checkpoint to resume from, or it was made with different parameters. "
+					<< "Run ag_train with the same arguments as the interrupted run.\n"; 
+				break;
 		}
 		return 1;
 	}catch(exception &e){
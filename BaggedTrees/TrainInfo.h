@@ -11,6 +11,7 @@ public:
 	int seed;			//random number initializer
 	double alpha;		//min proportion of train set in the leaf (controls size of tree)
 	bool rms;			//rms/roc performance metric
+	bool earlyStop;		//bagging stops as soon as the bagging curve converges
 
 	//file names
 	string trainFName;	//train set
@@ -18,5 +19,5 @@ public:
 	string testFName;	//test set
 	string attrFName;	//attributes description 	
 
-	TrainInfo(): bagN(60), seed(1), alpha(0), rms(true) {};
+	TrainInfo(): bagN(60), seed(1), alpha(0), rms(true), earlyStop(false) {};
 };
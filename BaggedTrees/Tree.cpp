@@ -57,6 +57,7 @@ public:
 
 CTree::CTree(double alphaIn): alpha(alphaIn), root()
 {
+	root.setSeed(rand());
 }
 
 //Generates a tree and increases attribute counts
@@ -173,9 +174,21 @@ void CTree::load(fstream& fload)
 	}	
 }
 
+//adds the tree to a compiled model as a new group
+void CTree::compile(CCompiledModel& model)
+{
+	model.addGroup();
+	model.addTree(root);
+}
+
 //Calculates prediction for one data point
 double CTree::predict(int itemNo, DATA_SET dset)
 {
+	//most cases have no missing values on their path and end up in a single leaf with coefficient 1
+	CTreeNode* pLeaf = root.findLeaf(pData->getRow(itemNo, dset));
+	if(pLeaf)
+		return pLeaf->getResp();
+
 	//Implementation note: because of missing values, the item can end up in several leaves with
 	//different coefficients. We trace which nodes it visits and what coefficients it has in each
 	//node
@@ -4,6 +4,7 @@
 
 #pragma once
 #include "TreeNode.h"
+#include "CompiledModel.h"
 
 #ifndef _WIN32
 #include "thread_pool.h"
@@ -35,6 +36,9 @@ public:
 	//calculates prediction of the model for a single item
 	double predict(int itemNo, DATA_SET dset);
 
+	//adds the tree to a compiled model as a new group
+	void compile(CCompiledModel& model);
+
 	//loads data into the root
 	void setRoot();
 
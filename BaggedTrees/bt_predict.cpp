@@ -13,7 +13,7 @@
 
 
 //bt_predict -p _test_set_ -r _attr_file_ [-m _model_file_name_] [-o _output_file_name_] [-c rms|roc]
-//[-l log|nolog]
+//[-l log|nolog] [-h _threads_]
 int main(int argc, char* argv[])
 {	 
 	try{
@@ -21,6 +21,7 @@ int main(int argc, char* argv[])
 //1. Analyze input parameters
 	string modelFName = "model.bin";	//name of the input file for the model
 	string predFName = "preds.txt";		//name of the output file for predictions
+	int threadN = 6;					//number of threads
 	bool doOut = true; //whether to output log information to stdout
 	
 	TrainInfo ti;
@@ -72,6 +73,12 @@ int main(int argc, char* argv[])
 			else
 				throw INPUT_ERR;
 		}
+		else if(!args[argNo].compare("-h"))
+#ifndef _WIN32 
+			threadN = atoiExt(argv[argNo + 1]);
+#else
+			throw WIN_ERR;
+#endif
 		else
 			throw INPUT_ERR;
 	}
@@ -110,6 +117,7 @@ int main(int argc, char* argv[])
 	doublev testTar;
 	int testN = data.getTargets(testTar, TEST);
 	doublev preds(testN, 0);
+	CCompiledModel model;	//all trees of the model in flat arrays
 
 	ti.bagN = 0;
 	while(fmodel.peek() != char_traits<char>::eof())
@@ -118,13 +126,18 @@ int main(int argc, char* argv[])
 		cout << "Iteration " << ti.bagN << endl;
 		CTree tree;
 		tree.load(fmodel);
-
-		//get predictions, add them to predictions of previous models
-		for(int itemNo = 0; itemNo < testN; itemNo++)
-			preds[itemNo] += tree.predict(itemNo, TEST);
+		tree.compile(model);
 	}
 
-	//get bagged predictions of the ensemble
+	//get bagged predictions of the ensemble, blocks of cases are processed in parallel
+#ifndef _WIN32
+	TThreadPool pool(threadN);
+	CCompiledModel::setPool(&pool);
+#endif
+	vector<const float*> rows(testN);
+	for(int itemNo = 0; itemNo < testN; itemNo++)
+		rows[itemNo] = data.getRow(itemNo, TEST);
+	model.predictBatch(rows, preds);
 	for(int itemNo = 0; itemNo < testN; itemNo++)
 		preds[itemNo] /= ti.bagN;
 	
@@ -162,7 +175,10 @@ int main(int argc, char* argv[])
 		{
 			case INPUT_ERR:
 				errlog << "Usage: bt_predict -p _test_set_ -r _attr_file_name_ "
-					<< "[-m _model_file_name_] [-o _output_file_name_] [-c rms|roc] [-l log|nolog]\n";
+					<< "[-m _model_file_name_] [-o _output_file_name_] [-c rms|roc] [-l log|nolog]\n\t[-h _threads_]\n";
+				break;
+			case WIN_ERR:
+				errlog << "Input error: TreeExtra currently does not support multithreading for Windows.\n";
 				break;
 			default:
 				throw err;
@@ -4,7 +4,7 @@
 
 //bt_train -t _train_set_ -v _validation_set_ -r _attr_file_ 
 //[-a _alpha_value_] [-b _bagging_iterations_] [-i _init_random_] [-m_model_file_name_]
-//[-k _attributes_to_leave_] [-l log|nolog] [-c rms|roc]
+//[-k _attributes_to_leave_] [-l log|nolog] [-c rms|roc] [-stop on|off] [-resume on|off]
 
 #include "Tree.h"
 #include "bt_functions.h"
@@ -16,10 +16,151 @@
 
 #ifndef _WIN32
 #include "thread_pool.h"
+#include <unistd.h>
+#else
+#include <io.h>
+#include <fcntl.h>
 #endif
 
 #include <algorithm>
 #include <errno.h>
+#include <cstdio>
+#include <sstream>
+
+//State of training after a completed bagging iteration
+struct CheckpointInfo
+{
+	string signature;	//parameters of the run, training can be resumed only with the same parameters
+	int bagDoneN;		//number of completed bagging iterations
+	int bagN;			//number of bagging iterations, smaller than requested if training stopped early
+	long long modelSize;	//size of the model file in bytes
+	doublev rmsV;		//bagging curve of rms values
+	doublev rocV;		//bagging curve of roc values
+	doublev predsumsV;	//sums of predictions for validation data points
+	idpairv attrCounts;	//counts of attribute importance
+};
+
+//writes a vector into a binary stream, preceded by its size
+void writeVec(fstream& fbin, doublev& vec)
+{
+	int size = (int)vec.size();
+	fbin.write((char*) &size, sizeof(int));
+	if(size > 0)
+		fbin.write((char*) &vec[0], sizeof(double) * size);
+}
+
+//reads a vector written by writeVec
+void readVec(fstream& fbin, doublev& vec)
+{
+	int size = 0;
+	fbin.read((char*) &size, sizeof(int));
+	if(fbin.fail() || (size < 0))
+		return;
+	vec.resize(size);
+	if(size > 0)
+		fbin.read((char*) &vec[0], sizeof(double) * size);
+}
+
+//saves the state of training into _model_file_name_.checkpoint. 
+//The checkpoint is written into a temporary file first, so that a crash does not destroy the previous one
+void saveCheckpoint(CheckpointInfo& ci, string modelFName)
+{
+	string fName = modelFName + ".checkpoint";
+	string tmpFName = modelFName + ".checkpoint.tmp";
+	fstream fcheck(tmpFName.c_str(), ios_base::binary | ios_base::out);
+
+	int sigLen = (int)ci.signature.size();
+	fcheck.write((char*) &sigLen, sizeof(int));
+	fcheck.write(ci.signature.data(), sigLen);
+	fcheck.write((char*) &ci.bagDoneN, sizeof(int));
+	fcheck.write((char*) &ci.bagN, sizeof(int));
+	fcheck.write((char*) &ci.modelSize, sizeof(long long));
+
+	writeVec(fcheck, ci.rmsV);
+	writeVec(fcheck, ci.rocV);
+	writeVec(fcheck, ci.predsumsV);
+	int attrN = (int)ci.attrCounts.size();
+	fcheck.write((char*) &attrN, sizeof(int));
+	for(int attrNo = 0; attrNo < (int)ci.attrCounts.size(); attrNo++)
+	{
+		fcheck.write((char*) &ci.attrCounts[attrNo].first, sizeof(int));
+		fcheck.write((char*) &ci.attrCounts[attrNo].second, sizeof(double));
+	}
+
+	fcheck.close();
+	if(fcheck.fail())
+		throw TREE_WRITE_ERR;
+
+#ifdef _WIN32
+	remove(fName.c_str());	//rename does not replace existing files in windows
+#endif
+	if(rename(tmpFName.c_str(), fName.c_str()) != 0)
+		throw TREE_WRITE_ERR;
+}
+
+//loads the state of training from _model_file_name_.checkpoint. 
+//Returns false if there is no checkpoint or it was made with different parameters
+bool loadCheckpoint(CheckpointInfo& ci, string modelFName)
+{
+	string fName = modelFName + ".checkpoint";
+	fstream fcheck(fName.c_str(), ios_base::binary | ios_base::in);
+	if(!fcheck.is_open())
+		return false;
+
+	int sigLen = 0;
+	fcheck.read((char*) &sigLen, sizeof(int));
+	if(fcheck.fail() || (sigLen != (int)ci.signature.size()))
+		return false;
+	string signature(sigLen, ' ');
+	if(sigLen > 0)
+		fcheck.read(&signature[0], sigLen);
+	if(fcheck.fail() || signature.compare(ci.signature))
+		return false;
+
+	fcheck.read((char*) &ci.bagDoneN, sizeof(int));
+	fcheck.read((char*) &ci.bagN, sizeof(int));
+	fcheck.read((char*) &ci.modelSize, sizeof(long long));
+
+	readVec(fcheck, ci.rmsV);
+	readVec(fcheck, ci.rocV);
+	readVec(fcheck, ci.predsumsV);
+	int attrN = 0;
+	fcheck.read((char*) &attrN, sizeof(int));
+	if(fcheck.fail() || (attrN < 0))
+		return false;
+	ci.attrCounts.resize(attrN);
+	for(int attrNo = 0; attrNo < (int)ci.attrCounts.size(); attrNo++)
+	{
+		fcheck.read((char*) &ci.attrCounts[attrNo].first, sizeof(int));
+		fcheck.read((char*) &ci.attrCounts[attrNo].second, sizeof(double));
+	}
+
+	return !fcheck.fail();
+}
+
+//cuts the model file back to the given size in place, drops trees saved after the checkpoint.
+//The part of the file covered by the checkpoint is never rewritten
+void truncateModel(string modelFName, long long modelSize)
+{
+	//the file can not be shorter than it was when the checkpoint was saved
+	fstream fmodel(modelFName.c_str(), ios_base::binary | ios_base::in | ios_base::ate);
+	if(fmodel.fail() || (modelSize < 0) || ((long long)fmodel.tellg() < modelSize))
+		throw RESUME_ERR;
+	fmodel.close();
+
+#ifndef _WIN32
+	if(truncate(modelFName.c_str(), (off_t)modelSize) != 0)
+		throw TREE_WRITE_ERR;
+#else
+	int fd = _open(modelFName.c_str(), _O_RDWR | _O_BINARY);
+	if(fd == -1)
+		throw TREE_WRITE_ERR;
+	bool failed = (_chsize_s(fd, modelSize) != 0);
+	_close(fd);
+	if(failed)
+		throw TREE_WRITE_ERR;
+#endif
+}
 
 int main(int argc, char* argv[])
 {	
@@ -45,6 +186,7 @@ int main(int argc, char* argv[])
 							//(0 = do not do feature selection)
 							//(-1 = output all available features)
 	bool doOut = true; //whether to output log information to stdout
+	bool resume = false; //whether to continue an interrupted run from its last checkpoint
 
 	//parse and save input parameters
 	//indicators of presence of required flags in the input
@@ -101,6 +243,24 @@ int main(int argc, char* argv[])
 			else
 				throw INPUT_ERR;
 		}
+		else if(!args[argNo].compare("-stop"))
+		{
+			if(!args[argNo + 1].compare("on"))
+				ti.earlyStop = true;
+			else if(!args[argNo + 1].compare("off"))
+				ti.earlyStop = false;
+			else
+				throw INPUT_ERR;
+		}
+		else if(!args[argNo].compare("-resume"))
+		{
+			if(!args[argNo + 1].compare("on"))
+				resume = true;
+			else if(!args[argNo + 1].compare("off"))
+				resume = false;
+			else
+				throw INPUT_ERR;
+		}
 		else if(!args[argNo].compare("-h"))
 #ifndef _WIN32 
 			threadN = atoiExt(argv[argNo + 1]);
@@ -117,16 +277,16 @@ int main(int argc, char* argv[])
 	if((ti.alpha < 0) || (ti.alpha > 1))
 		throw ALPHA_ERR;
 	
-//1.a) Set log file
+//1.a) Set log file. A resumed run continues the log of the interrupted one
 	LogStream clog;
-	LogStream::init(doOut);
+	if(!resume)
+		LogStream::init(doOut);
 	clog << "\n-----\nbt_train ";
 	for(int argNo = 1; argNo < argc; argNo++)
 		clog << argv[argNo] << " ";
 	clog << "\n\n";
 
-//1.b) Initialize random number generator. 
-	srand(ti.seed);
+	//the random number generator is initialized on every bagging iteration, see bagSeed
 
 //2. Load data
 	INDdata data(ti.trainFName.c_str(), ti.validFName.c_str(), ti.testFName.c_str(), 
@@ -179,30 +339,60 @@ int main(int argc, char* argv[])
 			attrCounts[attrNo].second = 0;		//counts
 		}
 	}
-	fstream fmodel(modelFName.c_str(), ios_base::binary | ios_base::out);
-	//header for compatibility with Additive Groves model
-	AG_TRAIN_MODE modeStub = SLOW;
-	fmodel.write((char*) &modeStub, sizeof(enum AG_TRAIN_MODE));
-	int tigNStub = 1;
-	fmodel.write((char*) &tigNStub, sizeof(int));
-	fmodel.write((char*) &ti.alpha, sizeof(double));
-	fmodel.close();
+
+	//state of training is saved after every bagging iteration
+	CheckpointInfo ci;
+	ostringstream signature;
+	signature << ti.seed << '\n' << ti.trainFName << '\n' << ti.validFName << '\n' << ti.attrFName << '\n' 
+		<< ti.alpha << ' ' << ti.bagN << ' ' << ti.rms << ' ' << ti.earlyStop << ' ' << topAttrN;
+	ci.signature = signature.str();
+	int startBagNo = 0;
+	if(resume)
+	{
+		if(!loadCheckpoint(ci, modelFName))
+			throw RESUME_ERR;
+		startBagNo = ci.bagDoneN;
+		ti.bagN = ci.bagN;
+		rmsV = ci.rmsV;
+		rocV = ci.rocV;
+		predsumsV = ci.predsumsV;
+		attrCounts = ci.attrCounts;
+		truncateModel(modelFName, ci.modelSize);
+		clog << "Resuming training after " << startBagNo << " bagging iterations\n\n";
+	}
+	else
+	{
+		fstream fmodel(modelFName.c_str(), ios_base::binary | ios_base::out);
+		//header for compatibility with Additive Groves model
+		AG_TRAIN_MODE modeStub = SLOW;
+		fmodel.write((char*) &modeStub, sizeof(enum AG_TRAIN_MODE));
+		int tigNStub = 1;
+		fmodel.write((char*) &tigNStub, sizeof(int));
+		fmodel.write((char*) &ti.alpha, sizeof(double));
+		fmodel.close();
+	}
 	
+	//bagging curves are rewritten from the checkpoint when training is resumed
 	fstream fbagrms("bagging_rms.txt", ios_base::out); //bagging curve (rms)
+	for(int bagNo = 0; bagNo < startBagNo; bagNo++)
+		fbagrms << rmsV[bagNo] << endl;
 	fbagrms.close();
 	fstream fbagroc;
 	if(!ti.rms)
 	{
 		fbagroc.open("bagging_roc.txt", ios_base::out); //bagging curve (roc) 
+		for(int bagNo = 0; bagNo < startBagNo; bagNo++)
+			fbagroc << rocV[bagNo] << endl;
 		fbagroc.close();
 	}
 
 	//make bags, build trees, collect predictions
-	for(int bagNo = 0; bagNo < ti.bagN; bagNo++)
+	for(int bagNo = startBagNo; bagNo < ti.bagN; bagNo++)
 	{
 		if(doOut)
 			cout << "Iteration " << bagNo + 1 << " out of " << ti.bagN << endl;
 
+		srand(bagSeed(ti.seed, bagNo));
 		data.newBag();
 		CTree tree(ti.alpha);
 		tree.setRoot();
@@ -232,7 +422,32 @@ int main(int argc, char* argv[])
 			fbagroc << rocV[bagNo] << endl;
 			fbagroc.close();
 		}
+
+		//early stopping: same criterion as the recommendation on more bagging.
+		//The model file already contains all trees built so far
+		if(ti.earlyStop && (bagNo < ti.bagN - 1) && !moreBag(doublev(rmsV.begin(), rmsV.begin() + bagNo + 1)))
+		{
+			clog << "The bagging curve has converged, training stopped after " << bagNo + 1 
+				<< " out of " << ti.bagN << " bagging iterations.\n";
+			ti.bagN = bagNo + 1;
+			rmsV.resize(ti.bagN);
+			if(!ti.rms)
+				rocV.resize(ti.bagN);
+		}
+
+		//save the state of training, the model file already contains the tree
+		ci.bagDoneN = bagNo + 1;
+		ci.bagN = ti.bagN;
+		fstream fmodel(modelFName.c_str(), ios_base::binary | ios_base::in | ios_base::ate);
+		ci.modelSize = (long long)fmodel.tellg();
+		fmodel.close();
+		ci.rmsV = rmsV;
+		ci.rocV = rocV;
+		ci.predsumsV = predsumsV;
+		ci.attrCounts = attrCounts;
+		saveCheckpoint(ci, modelFName);
 	}
+	remove((modelFName + ".checkpoint").c_str());
 
 	if(doFS)	//sort attributes by counts
 		sort(attrCounts.begin(), attrCounts.end(), idGreater);
@@ -298,7 +513,11 @@ int main(int argc, char* argv[])
 				errlog << "Usage: bt_train -t _train_set_ -v _validation_set_ -r _attr_file_ "
 					<< "[-a _alpha_value_] [-b _bagging_iterations_] [-i _init_random_] " 
 					<< "[-m _model_file_name_] [-k _attributes_to_leave_] [-c rms|roc] "
-					<< "[-l log|nolog]\n";
+					<< "[-l log|nolog] [-stop on|off] [-resume on|off]\n";
+				break;
+			case RESUME_ERR:
+				errlog << "Error: no checkpoint to resume from, or it was made with different parameters. "
+					<< "Run bt_train with the same arguments as the interrupted run.\n";
 				break;
 			case ALPHA_ERR:
 				errlog << "Error: alpha value is out of [0;1] range.\n";
@@ -0,0 +1,52 @@
+//BagInfo.h: BagInfo structure
+//
+// (c) Daria Sorokina
+
+#pragma once
+#include "ItemInfo.h"
+
+//A standalone copy of a bag of training data. Used when several models are trained
+//on different bags at the same time
+struct BagInfo
+{
+	//returns ids and targets of out-of-bag data points
+	int getOutOfBag(intv& oobData_out, doublev& oobTar_out)
+	{
+		oobData_out = oobData;
+		oobTar_out = oobTar;
+		return (int)oobData.size();
+	}
+
+	//fills itemSet with ids and responses of data points in the bag
+	void getCurBag(ItemInfov& itemSet)
+	{
+		int sampleN = (int)bootstrap.size();
+		itemSet.resize(sampleN);
+		for(int i = 0; i < sampleN; i++)
+		{
+			itemSet[i].key = bootstrap[i];
+			itemSet[i].coef = 1;
+			itemSet[i].response = bagTar[i];
+		}
+	}
+
+	//returns ids and responses of data points in the bag
+	int getCurBag(intv& bagData, doublev& bagTar_out)
+	{
+		bagData = bootstrap;
+		bagTar_out = bagTar;
+		return (int)bootstrap.size();
+	}
+
+	//creates a copy of sorted indexes of the bag
+	void getSortedData(fipairvv& sorted)
+	{
+		sorted = sortedItems;
+	}
+
+	intv bootstrap;			//indexes of data points in the bag, can be repeating
+	doublev bagTar;			//targets for data points in the bag
+	intv oobData;			//indexes of out-of-bag data points
+	doublev oobTar;			//targets for out-of-bag data points
+	fipairvv sortedItems;	//copies of the bag sorted by values of active continuous attributes
+};
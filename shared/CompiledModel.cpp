@@ -0,0 +1,959 @@
+// CompiledModel.cpp: implementation of the CCompiledModel class.
+//
+// (c) Daria Sorokina
+
+#include "CompiledModel.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+TThreadPool* CCompiledModel::pPool = NULL;
+
+//data for a job of predictBatch: a range of rows
+struct BatchJobData
+{
+	CCompiledModel* pModel;
+	const float* const* rows;
+	int rowN;
+	double* preds;
+};
+
+//job class, calculates predictions for a range of rows, used for multithreading in unix
+class CBatchJob : public TThreadPool::TJob
+{
+public:
+    
+    CBatchJob() : TThreadPool::TJob() { }
+    
+    void Run(void* ptr)
+    {
+		BatchJobData* pJD = (BatchJobData*) ptr;
+		pJD->pModel->predictRange(pJD->rows, pJD->rowN, pJD->preds);
+    }
+};
+#endif
+
+//returns the largest float that is not greater than the given value.
+//For any float x: x <= value if and only if x <= floatFloor(value)
+static float floatFloor(double value)
+{
+	if(wxisNaN(value))	//special split: all non-missing values go left
+		return flim::infinity();
+
+	float ret = (float)value;
+	if((double)ret > value)
+	{//rounding went up, step down to the previous float
+		unsigned int bits;
+		memcpy(&bits, &ret, sizeof(float));
+		if(ret > 0)
+			bits--;
+		else if(ret < 0)
+			bits++;
+		else
+			bits = 0x80000001;	//smallest negative float
+		memcpy(&ret, &bits, sizeof(float));
+	}
+	return ret;
+}
+
+//returns C++ literal for a float value, precise enough to get the same float back
+static string floatCode(float value)
+{
+	if(value == flim::infinity())
+		return "inf";
+	ostringstream code;
+	code << setprecision(9) << value;
+	string ret = code.str();
+	if(ret.find_first_of(".e") == string::npos)
+		ret += ".0";
+	return ret + "f";
+}
+
+//returns C++ literal for a double value, precise enough to get the same double back
+static string doubleCode(double value)
+{
+	ostringstream code;
+	code << setprecision(17) << value;
+	return code.str();
+}
+
+//constructor
+CCompiledModel::CCompiledModel(): attrN(0), mapData(NULL), mapSize(0), useQS(false)
+{
+	setArrays();
+}
+
+//destructor, releases the mapped model file
+CCompiledModel::~CCompiledModel()
+{
+	if(mapData == NULL)
+		return;
+#ifndef _WIN32
+	munmap(mapData, mapSize);
+#else
+	delete [] mapData;
+#endif
+}
+
+//points arrays used in prediction to the vectors. Should be called after every change of the vectors
+void CCompiledModel::setArrays()
+{
+	nodeN = (int)nodes.size();
+	treeN = (int)roots.size();
+	groupN = (int)groupStarts.size();
+	pNodes = nodes.empty() ? NULL : &nodes[0];
+	pMissingL = missingL.empty() ? NULL : &missingL[0];
+	pLeafVals = leafVals.empty() ? NULL : &leafVals[0];
+	pRoots = roots.empty() ? NULL : &roots[0];
+	pGroupStarts = groupStarts.empty() ? NULL : &groupStarts[0];
+	pDepths = depths.empty() ? NULL : &depths[0];
+	pBorders = borders.empty() ? NULL : &borders[0];
+	pBatchAttr = batchAttr.empty() ? NULL : &batchAttr[0];
+	pBatchThresh = batchThresh.empty() ? NULL : &batchThresh[0];
+	pBatchChild = batchChild.empty() ? NULL : &batchChild[0];
+}
+
+//starts a new group of trees
+void CCompiledModel::addGroup()
+{
+	if(mapData != NULL)
+		throw MODEL_ERR;
+	groupStarts.push_back((int)roots.size());
+	setArrays();
+}
+
+//adds a tree to the last group
+void CCompiledModel::addTree(CTreeNode& root)
+{
+	if(mapData != NULL)
+		throw MODEL_ERR;
+	if(groupStarts.empty())
+		addGroup();
+
+	typedef pair<CTreeNode*, int> nodeidxp;	//node of the original tree and its index in the compiled one
+	stack<nodeidxp> toCopy;
+	int rootNo = (int)nodes.size();
+	roots.push_back(rootNo);
+	nodes.push_back(CompiledNode());
+	missingL.push_back(0);
+	borders.push_back(0);
+	toCopy.push(nodeidxp(&root, roots.back()));
+
+	while(!toCopy.empty())
+	{
+		CTreeNode* pNode = toCopy.top().first;
+		int nodeNo = toCopy.top().second;
+		toCopy.pop();
+
+		if(pNode->isLeaf())
+		{
+			nodes[nodeNo].attr = -1;
+			nodes[nodeNo].thresh = 0;
+			nodes[nodeNo].child = (int)leafVals.size();
+			leafVals.push_back(pNode->getResp());
+		}
+		else
+		{
+			int childNo = (int)nodes.size();
+			nodes[nodeNo].attr = pNode->getDivAttr();
+			nodes[nodeNo].thresh = floatFloor(pNode->getThresh());
+			nodes[nodeNo].child = childNo;
+			missingL[nodeNo] = pNode->getMissingL();
+			borders[nodeNo] = pNode->getThresh();
+
+			nodes.resize(childNo + 2);
+			missingL.resize(childNo + 2, 0);
+			borders.resize(childNo + 2, 0);
+			toCopy.push(nodeidxp(pNode->right, childNo + 1));
+			toCopy.push(nodeidxp(pNode->left, childNo));
+		}
+	}
+
+	finishTree(rootNo);
+}
+
+//fills the copies of the last added tree for batch prediction, children always follow their parents in the array
+void CCompiledModel::finishTree(int rootNo)
+{
+	nodeN = (int)nodes.size();
+	batchAttr.resize(nodeN);
+	batchThresh.resize(nodeN);
+	batchChild.resize(nodeN);
+	intv nodeDepths(nodeN - rootNo, 0);
+	int depth = 0;
+	for(int nodeNo = rootNo; nodeNo < nodeN; nodeNo++)
+	{
+		CompiledNode& node = nodes[nodeNo];
+		if(node.attr < 0)
+		{
+			batchAttr[nodeNo] = 0;
+			batchThresh[nodeNo] = flim::infinity();
+			batchChild[nodeNo] = nodeNo;
+			depth = max(depth, nodeDepths[nodeNo - rootNo]);
+		}
+		else
+		{
+			batchAttr[nodeNo] = node.attr;
+			batchThresh[nodeNo] = node.thresh;
+			batchChild[nodeNo] = node.child;
+			nodeDepths[node.child - rootNo] = nodeDepths[node.child + 1 - rootNo] = nodeDepths[nodeNo - rootNo] + 1;
+			attrN = max(attrN, node.attr + 1);
+		}
+	}
+	depths.push_back(depth);
+	setArrays();
+}
+
+//returns the sum of predictions of all groups for a single case
+double CCompiledModel::predict(const float* row)
+{
+	double ret = 0;
+	for(int groupNo = 0; groupNo < groupN; groupNo++)
+	{
+		int lastTreeNo = (groupNo < groupN - 1) ? pGroupStarts[groupNo + 1] : treeN;
+		double groupPred = 0;
+		for(int treeNo = pGroupStarts[groupNo]; treeNo < lastTreeNo; treeNo++)
+			groupPred += treePredict(pRoots[treeNo], row);
+		ret += groupPred;
+	}
+	return ret;
+}
+
+//calculates predictions for a set of cases. Every case is processed the same way by a single thread, 
+//so the results do not depend on the number of threads
+void CCompiledModel::predictBatch(const vector<const float*>& rows, doublev& preds)
+{
+	int rowN = (int)rows.size();
+	preds.resize(rowN);
+	if(rowN == 0)
+		return;
+
+#ifndef _WIN32
+	if((pPool != NULL) && (rowN > JOB_ROWN))
+	{//split rows into jobs of JOB_ROWN rows
+		int jobN = (rowN - 1) / JOB_ROWN + 1;
+		vector<BatchJobData> jobs(jobN);
+		for(int jobNo = 0; jobNo < jobN; jobNo++)
+		{
+			jobs[jobNo].pModel = this;
+			jobs[jobNo].rows = &rows[jobNo * JOB_ROWN];
+			jobs[jobNo].rowN = min(JOB_ROWN, rowN - jobNo * JOB_ROWN);
+			jobs[jobNo].preds = &preds[jobNo * JOB_ROWN];
+			pPool->Run(new CBatchJob(), &jobs[jobNo], true);
+		}
+		pPool->SyncAll();
+		return;
+	}
+#endif
+	predictRange(&rows[0], rowN, &preds[0]);
+}
+
+//calculates predictions for a range of cases block by block
+void CCompiledModel::predictRange(const float* const* rows, int rowN, double* preds)
+{
+	if(useQS)
+	{//QuickScorer processes cases one by one, cases with missing values use the usual traversal
+		vector<leafmask> bits(treeN + 1);
+		for(int rowNo = 0; rowNo < rowN; rowNo++)
+		{
+			bool hasMV = false;
+			for(int attrNo = 0; attrNo < attrN; attrNo++)
+				hasMV = hasMV || wxisNaN(rows[rowNo][attrNo]);
+			preds[rowNo] = hasMV ? predict(rows[rowNo]) : predictQS(rows[rowNo], &bits[0]);
+		}
+		return;
+	}
+
+	floatv block(max(attrN, 1) * BATCH_ROWN);
+	boolv hasMV(BATCH_ROWN);
+	for(int startNo = 0; startNo < rowN; startNo += BATCH_ROWN)
+	{
+		int blockN = min(BATCH_ROWN, rowN - startNo);
+
+		//copy the block column by column, replace missing values with 0 for now
+		for(int rowNo = 0; rowNo < blockN; rowNo++)
+			hasMV[rowNo] = false;
+		int mvN = 0;	//number of cases with missing values in the block
+		for(int attrNo = 0; attrNo < attrN; attrNo++)
+			for(int rowNo = 0; rowNo < blockN; rowNo++)
+			{
+				float value = rows[startNo + rowNo][attrNo];
+				if(wxisNaN(value))
+				{
+					mvN += hasMV[rowNo] ? 0 : 1;
+					hasMV[rowNo] = true;
+					value = 0;
+				}
+				block[attrNo * BATCH_ROWN + rowNo] = value;
+			}
+
+		if(mvN < blockN)
+			predictBlock(&block[0], blockN, &preds[startNo]);
+
+		//cases with missing values can go down several branches, they are processed one by one
+		for(int rowNo = 0; rowNo < blockN; rowNo++)
+			if(hasMV[rowNo])
+				preds[startNo + rowNo] = predict(rows[startNo + rowNo]);
+	}
+}
+
+//calculates predictions for a block of cases without missing values.
+//All cases of the block make one step down a tree together, the step has no branches
+void CCompiledModel::predictBlock(const float* block, int rowN, double* preds)
+{
+	int nodeNos[BATCH_ROWN];		//current nodes of cases
+	double groupPreds[BATCH_ROWN];	//predictions of the current group
+	for(int rowNo = 0; rowNo < rowN; rowNo++)
+		preds[rowNo] = 0;
+
+	for(int groupNo = 0; groupNo < groupN; groupNo++)
+	{
+		for(int rowNo = 0; rowNo < rowN; rowNo++)
+			groupPreds[rowNo] = 0;
+
+		int lastTreeNo = (groupNo < groupN - 1) ? pGroupStarts[groupNo + 1] : treeN;
+		for(int treeNo = pGroupStarts[groupNo]; treeNo < lastTreeNo; treeNo++)
+		{
+			for(int rowNo = 0; rowNo < rowN; rowNo++)
+				nodeNos[rowNo] = pRoots[treeNo];
+			for(int stepNo = 0; stepNo < pDepths[treeNo]; stepNo++)
+				for(int rowNo = 0; rowNo < rowN; rowNo++)
+				{
+					int nodeNo = nodeNos[rowNo];
+					float value = block[pBatchAttr[nodeNo] * BATCH_ROWN + rowNo];
+					nodeNos[rowNo] = pBatchChild[nodeNo] + (int)(value > pBatchThresh[nodeNo]);
+				}
+			for(int rowNo = 0; rowNo < rowN; rowNo++)
+				groupPreds[rowNo] += pLeafVals[pNodes[nodeNos[rowNo]].child];
+		}
+
+		for(int rowNo = 0; rowNo < rowN; rowNo++)
+			preds[rowNo] += groupPreds[rowNo];
+	}
+}
+
+//returns the number of the lowest bit set
+static inline int lowestBit(leafmask bits)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(bits);
+#else
+	int bitNo = 0;
+	for(; !(bits & 1); bitNo++)
+		bits >>= 1;
+	return bitNo;
+#endif
+}
+
+//prepares QuickScorer structures
+void CCompiledModel::useQuickScorer()
+{
+	vector<QSSplit> splits;
+	qsLeafStarts.assign(treeN, -1);
+	qsLeafVals.clear();
+	for(int treeNo = 0; treeNo < treeN; treeNo++)
+	{
+		//nodes of a tree follow each other in the array
+		int lastNodeNo = (treeNo < treeN - 1) ? pRoots[treeNo + 1] : nodeN;
+		int leafN = 0;
+		for(int nodeNo = pRoots[treeNo]; nodeNo < lastNodeNo; nodeNo++)
+			if(pNodes[nodeNo].attr < 0)
+				leafN++;
+		if(leafN > QS_MAX_LEAFN)
+			continue;
+
+		qsLeafStarts[treeNo] = (int)qsLeafVals.size();
+		leafN = 0;
+		qsNode(pRoots[treeNo], treeNo, leafN, splits);
+	}
+	sort(splits.begin(), splits.end());
+
+	int splitN = (int)splits.size();
+	qsThresh.resize(splitN);
+	qsTree.resize(splitN);
+	qsMask.resize(splitN);
+	qsAttrStarts.assign(attrN + 1, splitN);
+	for(int splitNo = splitN - 1; splitNo >= 0; splitNo--)
+	{
+		qsThresh[splitNo] = splits[splitNo].thresh;
+		qsTree[splitNo] = splits[splitNo].tree;
+		qsMask[splitNo] = splits[splitNo].mask;
+		qsAttrStarts[splits[splitNo].attr] = splitNo;
+	}
+	//attributes without splits start where the next attribute starts
+	for(int attrNo = attrN - 1; attrNo >= 0; attrNo--)
+		if((attrNo < attrN - 1) && (qsAttrStarts[attrNo] > qsAttrStarts[attrNo + 1]))
+			qsAttrStarts[attrNo] = qsAttrStarts[attrNo + 1];
+
+	useQS = true;
+}
+
+//collects QuickScorer splits and leaves of a subtree. Leaves are numbered from left to right, 
+//so leaves of any subtree form a range
+iipair CCompiledModel::qsNode(int nodeNo, int treeNo, int& leafN, vector<QSSplit>& splits)
+{
+	const CompiledNode& node = pNodes[nodeNo];
+	if(node.attr < 0)
+	{
+		qsLeafVals.push_back(pLeafVals[node.child]);
+		leafN++;
+		return iipair(leafN - 1, leafN - 1);
+	}
+
+	iipair leftLeaves = qsNode(node.child, treeNo, leafN, splits);
+	iipair rightLeaves = qsNode(node.child + 1, treeNo, leafN, splits);
+
+	QSSplit split;
+	split.attr = node.attr;
+	split.thresh = node.thresh;
+	split.tree = treeNo;
+	int leftN = leftLeaves.second - leftLeaves.first + 1;
+	leafmask leftBits = (leftN < QS_MAX_LEAFN) ? (((leafmask)1 << leftN) - 1) : ~(leafmask)0;
+	split.mask = ~(leftBits << leftLeaves.first);
+	splits.push_back(split);
+
+	return iipair(leftLeaves.first, rightLeaves.second);
+}
+
+//returns the number of trees handled by QuickScorer
+int CCompiledModel::getQSTreeN()
+{
+	int qsTreeN = 0;
+	for(int treeNo = 0; treeNo < (int)qsLeafStarts.size(); treeNo++)
+		if(qsLeafStarts[treeNo] >= 0)
+			qsTreeN++;
+	return qsTreeN;
+}
+
+//calculates prediction for a case without missing values with QuickScorer. A case goes right in all splits 
+//with thresholds smaller than its value, so only those splits are visited. The exit leaf of a tree is the 
+//leftmost leaf that was not cleared. Trees are summed in the same order as in predict
+double CCompiledModel::predictQS(const float* row, leafmask* bits)
+{
+	for(int treeNo = 0; treeNo < treeN; treeNo++)
+		bits[treeNo] = ~(leafmask)0;
+
+	for(int attrNo = 0; attrNo < attrN; attrNo++)
+	{
+		float value = row[attrNo];
+		int lastSplitNo = qsAttrStarts[attrNo + 1];
+		for(int splitNo = qsAttrStarts[attrNo]; (splitNo < lastSplitNo) && (qsThresh[splitNo] < value); splitNo++)
+			bits[qsTree[splitNo]] &= qsMask[splitNo];
+	}
+
+	double ret = 0;
+	for(int groupNo = 0; groupNo < groupN; groupNo++)
+	{
+		int lastTreeNo = (groupNo < groupN - 1) ? pGroupStarts[groupNo + 1] : treeN;
+		double groupPred = 0;
+		for(int treeNo = pGroupStarts[groupNo]; treeNo < lastTreeNo; treeNo++)
+			if(qsLeafStarts[treeNo] >= 0)
+				groupPred += qsLeafVals[qsLeafStarts[treeNo] + lowestBit(bits[treeNo])];
+			else
+				groupPred += treePredict(pRoots[treeNo], row);
+		ret += groupPred;
+	}
+	return ret;
+}
+
+//calculates prediction of a single tree.
+//Fast path: a case without missing values follows a single branch
+double CCompiledModel::treePredict(int nodeNo, const float* row)
+{
+	while(true)
+	{
+		const CompiledNode& node = pNodes[nodeNo];
+		if(node.attr < 0)
+			return pLeafVals[node.child];
+
+		float value = row[node.attr];
+		if(value <= node.thresh)
+			nodeNo = node.child;
+		else if(value > node.thresh)
+			nodeNo = node.child + 1;
+		else
+		{//missing value (NaN fails both comparisons), the case can go down both branches
+			double sum = 0;
+			predictMV(nodeNo, row, 1, sum);
+			return sum;
+		}
+	}
+}
+
+//calculates prediction of a subtree for a case with missing values. Right branches are visited first,
+//so that the leaves are summed in the same order as in CGrove::localPredict and CTree::predict
+void CCompiledModel::predictMV(int nodeNo, const float* row, double coef, double& sum)
+{
+	const CompiledNode& node = pNodes[nodeNo];
+	if(node.attr < 0)
+	{
+		sum += pLeafVals[node.child] * coef;
+		return;
+	}
+
+	float value = row[node.attr];
+	double lCoef;	//left coefficient, same as in SplitInfo::leftCoef
+	if(wxisNaN(value))
+		lCoef = pMissingL[nodeNo];
+	else
+		lCoef = (value <= node.thresh) ? 1 : 0;
+	double rCoef = 1 - lCoef;
+
+	double lOutCoef = lCoef * coef;
+	double rOutCoef = rCoef * coef;
+	if(rOutCoef)
+		predictMV(node.child + 1, row, rOutCoef, sum);
+	if(lOutCoef)
+		predictMV(node.child, row, lOutCoef, sum);
+}
+
+//outputs C++ source of the whole model as a function. Cases without missing values go down nested if-else 
+//statements, a case with a missing value switches to a table of nodes at that node. Leaf values are 
+//multiplied by leafCoef, so that averaging of bagged models can be folded into them
+void CCompiledModel::genCode(ostream& fcode, string funcName, double leafCoef, stringv& attrNames)
+{
+	fcode << "// " << funcName << ": prediction function generated from a TreeExtra model\n"
+		<< "// " << groupN << " groups, " << treeN << " trees, " << nodeN << " nodes\n"
+		<< "//\n"
+		<< "// double " << funcName << "(const float* d)\n"
+		<< "// d - values of all attributes in the order of the attribute file, without the response.\n"
+		<< "// Missing values are NaN\n//\n";
+	for(int attrNo = 0; attrNo < (int)attrNames.size(); attrNo++)
+		fcode << "// d[" << attrNo << "] - " << attrNames[attrNo] << "\n";
+	fcode << "\n"
+		<< "#include <limits>\n\n"
+		<< "namespace\n{\n"
+		<< "const float inf = std::numeric_limits<float>::infinity();\n\n"
+		<< "//node of a tree, used for cases with missing values\n"
+		<< "struct Node\n{\n"
+		<< "\tint attr;\t\t\t//split attribute, -1 for leaves\n"
+		<< "\tfloat thresh;\t\t//values not greater than it go left\n"
+		<< "\tint child;\t\t\t//left child, the right child follows it\n"
+		<< "\tdouble value;\t\t//leaf value\n"
+		<< "\tdouble missingL;\t//proportion of missing values going left\n"
+		<< "};\n\n"
+		<< "const Node nodes[] = {\n";
+	for(int nodeNo = 0; nodeNo < nodeN; nodeNo++)
+	{
+		const CompiledNode& node = pNodes[nodeNo];
+		if(node.attr < 0)
+			fcode << "\t{-1, 0.0f, 0, " << doubleCode(pLeafVals[node.child] * leafCoef) << ", 0}";
+		else
+			fcode << "\t{" << node.attr << ", " << floatCode(node.thresh) << ", " << node.child << ", 0, " 
+				<< doubleCode(pMissingL[nodeNo]) << "}";
+		fcode << ((nodeNo < nodeN - 1) ? ",\n" : "\n");
+	}
+	fcode << "};\n\n"
+		<< "//calculates prediction of a subtree for a case with missing values\n"
+		<< "void predictMV(int n, const float* d, double coef, double& sum)\n{\n"
+		<< "\tconst Node& node = nodes[n];\n"
+		<< "\tif(node.attr < 0)\n\t{\n\t\tsum += node.value * coef;\n\t\treturn;\n\t}\n"
+		<< "\tfloat v = d[node.attr];\n"
+		<< "\tdouble lCoef = (v != v) ? node.missingL : ((v <= node.thresh) ? 1 : 0);\n"
+		<< "\tdouble lOutCoef = lCoef * coef;\n"
+		<< "\tdouble rOutCoef = (1 - lCoef) * coef;\n"
+		<< "\tif(rOutCoef != 0)\n\t\tpredictMV(node.child + 1, d, rOutCoef, sum);\n"
+		<< "\tif(lOutCoef != 0)\n\t\tpredictMV(node.child, d, lOutCoef, sum);\n"
+		<< "}\n\n"
+		<< "double mv(int n, const float* d)\n{\n"
+		<< "\tdouble sum = 0;\n\tpredictMV(n, d, 1, sum);\n\treturn sum;\n}\n";
+
+	for(int treeNo = 0; treeNo < treeN; treeNo++)
+	{
+		fcode << "\ndouble tree" << treeNo << "(const float* d)\n{\n";
+		nodeCode(fcode, pRoots[treeNo], 1, leafCoef);
+		fcode << "}\n";
+	}
+	fcode << "}\n\n";
+
+	fcode << "extern \"C\" double " << funcName << "(const float* d)\n{\n"
+		<< "\tdouble ret = 0;\n\tdouble group;\n";
+	for(int groupNo = 0; groupNo < groupN; groupNo++)
+	{
+		int lastTreeNo = (groupNo < groupN - 1) ? pGroupStarts[groupNo + 1] : treeN;
+		fcode << "\tgroup = 0;\n";
+		for(int treeNo = pGroupStarts[groupNo]; treeNo < lastTreeNo; treeNo++)
+			fcode << "\tgroup += tree" << treeNo << "(d);\n";
+		fcode << "\tret += group;\n";
+	}
+	fcode << "\treturn ret;\n}\n";
+}
+
+//outputs C++ code of a subtree. Every branch is a single statement, so no braces are needed
+void CCompiledModel::nodeCode(ostream& fcode, int nodeNo, int level, double leafCoef)
+{
+	string indent(level, '\t');
+	const CompiledNode& node = pNodes[nodeNo];
+	if(node.attr < 0)
+	{
+		fcode << indent << "return " << doubleCode(pLeafVals[node.child] * leafCoef) << ";\n";
+		return;
+	}
+	string thresh = floatCode(node.thresh);
+	fcode << indent << "if(d[" << node.attr << "] <= " << thresh << ")\n";
+	nodeCode(fcode, node.child, level + 1, leafCoef);
+	fcode << indent << "else if(d[" << node.attr << "] > " << thresh << ")\n";
+	nodeCode(fcode, node.child + 1, level + 1, leafCoef);
+	fcode << indent << "else\n" << indent << "\treturn mv(" << nodeNo << ", d);\n";
+}
+
+//returns the size rounded up to a multiple of 8 bytes
+static long long align8(long long size)
+{
+	return (size + 7) / 8 * 8;
+}
+
+//calculates sizes of all sections of a model file of version 2 from the numbers in its header
+static void sectionSizes(const ModelFileHeader& header, long long* sizes)
+{
+	long long nodeN = header.nodeN;
+	sizes[DIRS_SEC] = header.dirN;
+	sizes[GROUPS_SEC] = header.groupN * (long long)sizeof(int);
+	sizes[ROOTS_SEC] = header.treeN * (long long)sizeof(int);
+	sizes[DEPTHS_SEC] = header.treeN * (long long)sizeof(int);
+	sizes[NODES_SEC] = nodeN * (long long)sizeof(CompiledNode);
+	sizes[MISSINGL_SEC] = nodeN * (long long)sizeof(double);
+	sizes[LEAFVALS_SEC] = header.leafN * (long long)sizeof(double);
+	sizes[BORDERS_SEC] = nodeN * (long long)sizeof(double);
+	sizes[BATCHATTR_SEC] = nodeN * (long long)sizeof(int);
+	sizes[BATCHTHRESH_SEC] = nodeN * (long long)sizeof(float);
+	sizes[BATCHCHILD_SEC] = nodeN * (long long)sizeof(int);
+}
+
+//saves the model into a file of version 2: header and flat arrays, every array starts at a multiple of 8 bytes
+void CCompiledModel::save(ostream& fsave, ModelFileHeader& header, boolv& dirs)
+{
+	int leafN = (int)leafVals.size();
+	memset(header.magic, 0, sizeof(header.magic));
+	strcpy(header.magic, MODEL_MAGIC);
+	header.version = MODEL_VERSION;
+	header.byteOrder = 0x01020304;
+	header.dirN = (int)dirs.size();
+	header.groupN = groupN;
+	header.treeN = treeN;
+	header.nodeN = nodeN;
+	header.leafN = leafN;
+	header.attrN = attrN;
+	header.reserved = 0;
+
+	vector<char> dirChars(dirs.begin(), dirs.end());
+	const void* sections[MODEL_SECTION_N] = {dirChars.empty() ? NULL : &dirChars[0], pGroupStarts, pRoots, 
+		pDepths, pNodes, pMissingL, pLeafVals, pBorders, pBatchAttr, pBatchThresh, pBatchChild};
+	long long sizes[MODEL_SECTION_N];
+	sectionSizes(header, sizes);
+
+	long long pos = align8(sizeof(ModelFileHeader));
+	for(int secNo = 0; secNo < MODEL_SECTION_N; secNo++)
+	{
+		header.offsets[secNo] = pos;
+		pos += align8(sizes[secNo]);
+	}
+
+	char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	fsave.write((char*) &header, sizeof(ModelFileHeader));
+	fsave.write(padding, align8(sizeof(ModelFileHeader)) - sizeof(ModelFileHeader));
+	for(int secNo = 0; secNo < MODEL_SECTION_N; secNo++)
+	{
+		if(sizes[secNo] > 0)
+			fsave.write((const char*) sections[secNo], sizes[secNo]);
+		fsave.write(padding, align8(sizes[secNo]) - sizes[secNo]);
+	}
+	if(fsave.bad() || fsave.fail())
+		throw TREE_WRITE_ERR;
+}
+
+//maps a model file of version 2 into memory. Checks the header, the positions of all arrays, 
+//all indexes in them and depths of trees, so that a corrupted file can not send prediction outside of the arrays
+void CCompiledModel::map(const char* fileName, ModelFileHeader& header, boolv& dirs)
+{
+	if(mapData != NULL || !roots.empty())
+		throw MODEL_ERR;
+
+#ifndef _WIN32
+	int fd = open(fileName, O_RDONLY);
+	if(fd < 0)
+		throw MODEL_ERR;
+	struct stat fileStat;
+	if((fstat(fd, &fileStat) != 0) || (fileStat.st_size < (off_t)sizeof(ModelFileHeader)))
+	{
+		close(fd);
+		throw MODEL_ERR;
+	}
+	void* addr = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(addr == MAP_FAILED)
+		throw MODEL_ERR;
+	mapData = (char*) addr;
+	mapSize = fileStat.st_size;
+#else
+	//no memory mapping in windows version, the file is read into a single buffer
+	fstream fmodel(fileName, ios_base::binary | ios_base::in);
+	fmodel.seekg(0, ios_base::end);
+	streamoff fileSize = fmodel.tellg();
+	if(fmodel.fail() || (fileSize < (streamoff)sizeof(ModelFileHeader)))
+		throw MODEL_ERR;
+	fmodel.seekg(0, ios_base::beg);
+	mapData = new char[(size_t)fileSize];
+	mapSize = (size_t)fileSize;
+	fmodel.read(mapData, fileSize);
+	if(fmodel.fail())
+		throw MODEL_ERR;
+#endif
+
+	memcpy(&header, mapData, sizeof(ModelFileHeader));
+	if(memcmp(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) || (header.version != MODEL_VERSION) 
+		|| (header.byteOrder != 0x01020304) || (header.dirN < 0) || (header.groupN < 1) 
+		|| (header.treeN < header.groupN) || (header.nodeN < header.treeN) || (header.leafN < header.treeN)
+		|| (header.attrN < 0))
+		throw MODEL_ERR;
+
+	long long sizes[MODEL_SECTION_N];
+	sectionSizes(header, sizes);
+	for(int secNo = 0; secNo < MODEL_SECTION_N; secNo++)
+		if((header.offsets[secNo] % 8 != 0) || (header.offsets[secNo] < (long long)sizeof(ModelFileHeader))
+			|| (header.offsets[secNo] > (long long)mapSize - sizes[secNo]))
+			throw MODEL_ERR;
+
+	const char* dirChars = mapData + header.offsets[DIRS_SEC];
+	dirs.assign(dirChars, dirChars + header.dirN);
+	pGroupStarts = (const int*) (mapData + header.offsets[GROUPS_SEC]);
+	pRoots = (const int*) (mapData + header.offsets[ROOTS_SEC]);
+	pDepths = (const int*) (mapData + header.offsets[DEPTHS_SEC]);
+	pNodes = (const CompiledNode*) (mapData + header.offsets[NODES_SEC]);
+	pMissingL = (const double*) (mapData + header.offsets[MISSINGL_SEC]);
+	pLeafVals = (const double*) (mapData + header.offsets[LEAFVALS_SEC]);
+	pBorders = (const double*) (mapData + header.offsets[BORDERS_SEC]);
+	pBatchAttr = (const int*) (mapData + header.offsets[BATCHATTR_SEC]);
+	pBatchThresh = (const float*) (mapData + header.offsets[BATCHTHRESH_SEC]);
+	pBatchChild = (const int*) (mapData + header.offsets[BATCHCHILD_SEC]);
+	groupN = header.groupN;
+	treeN = header.treeN;
+	nodeN = header.nodeN;
+	attrN = header.attrN;
+
+	//check indexes: groups and trees are in order, children follow their parents inside the same tree.
+	//Depths are calculated the same way as in finishTree, predictBlock relies on them
+	for(int groupNo = 0; groupNo < groupN; groupNo++)
+		if((pGroupStarts[groupNo] < ((groupNo == 0) ? 0 : pGroupStarts[groupNo - 1])) 
+			|| (pGroupStarts[groupNo] >= treeN) || ((groupNo == 0) && (pGroupStarts[0] != 0)))
+			throw MODEL_ERR;
+	intv nodeDepths;
+	for(int treeNo = 0; treeNo < treeN; treeNo++)
+	{
+		int rootNo = pRoots[treeNo];
+		int lastNodeNo = (treeNo < treeN - 1) ? pRoots[treeNo + 1] : nodeN;
+		if((rootNo < 0) || (rootNo >= lastNodeNo) || (lastNodeNo > nodeN))
+			throw MODEL_ERR;
+		nodeDepths.assign(lastNodeNo - rootNo, 0);
+		int depth = 0;
+		for(int nodeNo = rootNo; nodeNo < lastNodeNo; nodeNo++)
+		{
+			const CompiledNode& node = pNodes[nodeNo];
+			bool badLeaf = (node.attr < 0) && ((node.child < 0) || (node.child >= header.leafN) 
+				|| (pBatchChild[nodeNo] != nodeNo) || (pBatchThresh[nodeNo] != flim::infinity()));
+			bool badSplit = (node.attr >= 0) && ((node.attr >= attrN) || (node.child <= nodeNo) 
+				|| (node.child + 1 >= lastNodeNo) || (pBatchChild[nodeNo] != node.child) 
+				|| (pBatchAttr[nodeNo] != node.attr) || (pBatchThresh[nodeNo] != node.thresh));
+			if(badLeaf || badSplit || (pBatchAttr[nodeNo] < 0) || (pBatchAttr[nodeNo] >= max(attrN, 1)))
+				throw MODEL_ERR;
+
+			int childDepth = nodeDepths[nodeNo - rootNo] + 1;
+			if(node.attr < 0)
+				depth = max(depth, nodeDepths[nodeNo - rootNo]);
+			else
+				for(int childNo = node.child; childNo <= node.child + 1; childNo++)
+					nodeDepths[childNo - rootNo] = max(nodeDepths[childNo - rootNo], childDepth);
+		}
+		if(pDepths[treeNo] != depth)
+			throw MODEL_ERR;
+	}
+}
+
+//checks whether a file starts with the header of a model file of version 2
+bool CCompiledModel::isMappable(const char* fileName)
+{
+	fstream fmodel(fileName, ios_base::binary | ios_base::in);
+	char magic[sizeof(MODEL_MAGIC)];
+	fmodel.read(magic, sizeof(MODEL_MAGIC));
+	return !fmodel.fail() && !memcmp(magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+}
+
+//saves all trees in the format of a model file of version 1, same as CGrove::save and CTreeNode::save
+void CCompiledModel::saveTrees(ostream& fsave)
+{
+	for(int treeNo = 0; treeNo < treeN; treeNo++)
+	{
+		stack<int> toSave;	//roots of subtrees in the packing order
+		toSave.push(pRoots[treeNo]);
+		while(!toSave.empty())
+		{
+			int nodeNo = toSave.top();
+			toSave.pop();
+			const CompiledNode& node = pNodes[nodeNo];
+			bool leaf = (node.attr < 0);
+			fsave.write((char*) &leaf, sizeof(bool));
+			if(leaf)
+				fsave.write((char*) &pLeafVals[node.child], sizeof(double));
+			else
+			{
+				fsave.write((char*) &node.attr, sizeof(int));
+				fsave.write((char*) &pBorders[nodeNo], sizeof(double));
+				fsave.write((char*) &pMissingL[nodeNo], sizeof(double));
+				toSave.push(node.child + 1);
+				toSave.push(node.child);
+			}
+		}
+	}
+	if(fsave.bad() || fsave.fail())
+		throw TREE_WRITE_ERR;
+}
+
+//checks that all split attributes are active in the data, same check as in CTreeNode::load
+bool CCompiledModel::activeAttrs(INDdata& data)
+{
+	for(int nodeNo = 0; nodeNo < nodeN; nodeNo++)
+		if((pNodes[nodeNo].attr >= 0) && !data.isActive(pNodes[nodeNo].attr))
+			return false;
+	return true;
+}
+
+//returns a key of a subtree: splits with identical subtrees are skipped, so the subtrees that give 
+//the same predictions for all cases get the same key. Keys of children should be already set
+string CCompiledModel::nodeKey(int nodeNo, stringv& keys)
+{
+	const CompiledNode& node = pNodes[nodeNo];
+	if(node.attr < 0)
+		return "L" + string((const char*) &pLeafVals[node.child], sizeof(double));
+	if(keys[node.child] == keys[node.child + 1])
+		return keys[node.child];
+
+	int leftLen = (int)keys[node.child].size();
+	return "S" + string((const char*) &node.attr, sizeof(int)) + string((const char*) &node.thresh, sizeof(float)) 
+		+ string((const char*) &pBorders[nodeNo], sizeof(double)) + string((const char*) &pMissingL[nodeNo], sizeof(double))
+		+ string((const char*) &leftLen, sizeof(int)) + keys[node.child] + keys[node.child + 1];
+}
+
+//sets keys of all nodes of a tree, returns the number of the node after its last node
+int CCompiledModel::setKeys(int treeNo, stringv& keys)
+{
+	int lastNodeNo = (treeNo < treeN - 1) ? pRoots[treeNo + 1] : nodeN;
+	for(int nodeNo = lastNodeNo - 1; nodeNo >= pRoots[treeNo]; nodeNo--)
+		keys[nodeNo] = nodeKey(nodeNo, keys);
+	return lastNodeNo;
+}
+
+//skips splits with identical subtrees
+int CCompiledModel::skipSame(int nodeNo, stringv& keys)
+{
+	while((pNodes[nodeNo].attr >= 0) && (keys[pNodes[nodeNo].child] == keys[pNodes[nodeNo].child + 1]))
+		nodeNo = pNodes[nodeNo].child;
+	return nodeNo;
+}
+
+//builds the model as a compacted copy of source
+void CCompiledModel::compact(CCompiledModel& source, double leafCoef)
+{
+	if((mapData != NULL) || !roots.empty())
+		throw MODEL_ERR;
+
+	//find unique trees and constant trees
+	std::map<string, int> treeIds;	//keys of unique trees and their numbers
+	intv srcTrees;				//numbers of unique trees in the source
+	intv counts;				//numbers of copies of unique trees
+	double constSum = 0;		//sum of values of constant trees
+	bool hasConst = false;
+	stringv keys(source.nodeN);
+	for(int treeNo = 0; treeNo < source.treeN; treeNo++)
+	{
+		int rootNo = source.pRoots[treeNo];
+		int lastNodeNo = source.setKeys(treeNo, keys);
+		int topNo = source.skipSame(rootNo, keys);
+		if(source.pNodes[topNo].attr < 0)
+		{
+			constSum += source.pLeafVals[source.pNodes[topNo].child];
+			hasConst = true;
+		}
+		else if(treeIds.find(keys[rootNo]) != treeIds.end())
+			counts[treeIds[keys[rootNo]]]++;
+		else
+		{
+			treeIds[keys[rootNo]] = (int)srcTrees.size();
+			srcTrees.push_back(treeNo);
+			counts.push_back(1);
+		}
+		for(int nodeNo = rootNo; nodeNo < lastNodeNo; nodeNo++)
+			keys[nodeNo].clear();
+	}
+
+	//all trees go into a single group, constant trees are replaced with one leaf
+	addGroup();
+	if(hasConst)
+	{
+		int rootNo = (int)nodes.size();
+		roots.push_back(rootNo);
+		CompiledNode leaf = {-1, 0, (int)leafVals.size()};
+		nodes.push_back(leaf);
+		missingL.push_back(0);
+		borders.push_back(0);
+		leafVals.push_back(constSum * leafCoef);
+		finishTree(rootNo);
+	}
+
+	//copy unique trees without redundant splits
+	for(int uTreeNo = 0; uTreeNo < (int)srcTrees.size(); uTreeNo++)
+	{
+		int srcRootNo = source.pRoots[srcTrees[uTreeNo]];
+		int srcLastNodeNo = source.setKeys(srcTrees[uTreeNo], keys);
+		double coef = counts[uTreeNo] * leafCoef;
+
+		int rootNo = (int)nodes.size();
+		roots.push_back(rootNo);
+		nodes.push_back(CompiledNode());
+		missingL.push_back(0);
+		borders.push_back(0);
+		stack<iipair> toCopy;	//nodes of the source and their indexes in this model
+		toCopy.push(iipair(source.skipSame(srcRootNo, keys), rootNo));
+		while(!toCopy.empty())
+		{
+			int srcNodeNo = toCopy.top().first;
+			int nodeNo = toCopy.top().second;
+			toCopy.pop();
+
+			const CompiledNode& srcNode = source.pNodes[srcNodeNo];
+			if(srcNode.attr < 0)
+			{
+				nodes[nodeNo].attr = -1;
+				nodes[nodeNo].thresh = 0;
+				nodes[nodeNo].child = (int)leafVals.size();
+				leafVals.push_back(source.pLeafVals[srcNode.child] * coef);
+			}
+			else
+			{
+				int childNo = (int)nodes.size();
+				nodes[nodeNo].attr = srcNode.attr;
+				nodes[nodeNo].thresh = srcNode.thresh;
+				nodes[nodeNo].child = childNo;
+				missingL[nodeNo] = source.pMissingL[srcNodeNo];
+				borders[nodeNo] = source.pBorders[srcNodeNo];
+
+				nodes.resize(childNo + 2);
+				missingL.resize(childNo + 2, 0);
+				borders.resize(childNo + 2, 0);
+				toCopy.push(iipair(source.skipSame(srcNode.child + 1, keys), childNo + 1));
+				toCopy.push(iipair(source.skipSame(srcNode.child, keys), childNo));
+			}
+		}
+		finishTree(rootNo);
+
+		for(int nodeNo = srcRootNo; nodeNo < srcLastNodeNo; nodeNo++)
+			keys[nodeNo].clear();
+	}
+}
@@ -0,0 +1,256 @@
+// CompiledModel.h: interface for the CCompiledModel class.
+// Flattened copy of an ensemble of trees used for fast prediction. Nodes of all trees are kept in
+// a single array, both children of a node are neighbors in it. Prediction does not allocate memory.
+// The arrays can be saved into a model file of version 2 and mapped back into memory without parsing.
+
+// (c) Daria Sorokina
+
+#pragma once
+
+#include "TreeNode.h"
+#include "thread_pool.h"
+
+//number of rows pushed through the trees together by CCompiledModel::predictBatch
+#define BATCH_ROWN 32
+
+//number of rows in one job of multithreaded CCompiledModel::predictBatch
+#define JOB_ROWN 4096
+
+//node of a compiled tree
+struct CompiledNode
+{
+	int attr;		//split attribute id, -1 for leaves
+	float thresh;	//largest float not greater than the split point: values not greater than it go left
+	int child;		//index of the left child, the right child follows it. Index of the leaf value for leaves
+};
+
+typedef vector<CompiledNode> CompiledNodev;
+
+//bit vector of leaves of a tree used by QuickScorer, the leftmost leaf is the lowest bit
+typedef unsigned long long leafmask;
+
+//max number of leaves in a tree handled by QuickScorer
+#define QS_MAX_LEAFN 64
+
+//split of a tree in QuickScorer. When the value of the attribute is greater than the threshold, 
+//leaves of the left subtree cannot be the exit leaf: mask has zeros in their bits
+struct QSSplit
+{
+	int attr;		//split attribute id
+	float thresh;	//threshold
+	int tree;		//tree id
+	leafmask mask;	//all leaves except the ones in the left subtree
+
+	bool operator<(const QSSplit& other) const 
+	{
+		return (attr < other.attr) || ((attr == other.attr) && (thresh < other.thresh));
+	}
+};
+
+//first bytes of a model file of version 2, model files of version 1 have no header
+#define MODEL_MAGIC "TEMODEL"
+
+//current version of the memory mappable model file
+#define MODEL_VERSION 2
+
+//sections of a model file of version 2, every section is a flat array
+enum MODEL_SECTION
+{
+	DIRS_SEC = 0,		//directions on the training grid, fast mode only (char)
+	GROUPS_SEC,			//first tree of every group (int), an index that allows to seek to a bag
+	ROOTS_SEC,			//root nodes of trees (int)
+	DEPTHS_SEC,			//depths of trees (int)
+	NODES_SEC,			//nodes of all trees (CompiledNode)
+	MISSINGL_SEC,		//proportions of missing values going to the left (double)
+	LEAFVALS_SEC,		//values of leaves (double)
+	BORDERS_SEC,		//original split points, needed to restore a file of version 1 (double)
+	BATCHATTR_SEC,		//split attributes for batch prediction (int)
+	BATCHTHRESH_SEC,	//thresholds for batch prediction (float)
+	BATCHCHILD_SEC,		//left children for batch prediction (int)
+	MODEL_SECTION_N
+};
+
+//header of a model file of version 2. Sections follow it, each one starts at a multiple of 8 bytes,
+//so that the file can be mapped into memory and used for prediction in place
+struct ModelFileHeader
+{
+	char magic[8];			//MODEL_MAGIC
+	int version;			//MODEL_VERSION
+	int byteOrder;			//0x01020304 in the byte order of the machine that saved the file
+	unsigned int attrHash;	//hash of the attribute file, see INDdata::getAttrHash
+	int mode;				//training mode of Additive Groves
+	int maxTiGN;			//max number of trees in a grove used in training
+	int dirN;				//number of directions on the training grid
+	double minAlpha;		//min alpha value used in training
+	int groupN;				//number of groups of trees (bagging iterations)
+	int treeN;				//number of trees
+	int nodeN;				//number of nodes
+	int leafN;				//number of leaves
+	int attrN;				//number of attributes used by the trees + 1
+	int reserved;			//always 0
+	long long offsets[MODEL_SECTION_N];	//positions of sections in the file
+};
+
+//Ensemble of trees compiled into flat arrays. Trees are organized in groups (groves):
+//the prediction is the sum of groups' predictions, every group's prediction is the sum of its trees.
+//Predictions are exactly the same as the ones of the original trees
+class CCompiledModel
+{
+#ifndef _WIN32
+private:
+	static TThreadPool* pPool;
+public:
+	//sets thread pool used by predictBatch, NULL - predict in the calling thread
+	static void setPool(TThreadPool* pool){pPool = pool;}
+#endif
+
+public:
+	//starts a new group of trees
+	void addGroup();
+
+	//adds a tree to the last group
+	void addTree(CTreeNode& root);
+
+	//returns the sum of predictions of all groups for a single case,
+	//row contains values of all attributes of the case
+	double predict(const float* row);
+
+	//calculates predictions for a set of cases, processes them in blocks of BATCH_ROWN rows.
+	//Gives the same values as predict called for every row. Uses the thread pool if it is set
+	void predictBatch(const vector<const float*>& rows, doublev& preds);
+
+	//calculates predictions for rowN cases in the calling thread, block by block
+	void predictRange(const float* const* rows, int rowN, double* preds);
+
+	//switches prediction of cases without missing values to QuickScorer: splits of all trees are sorted
+	//by attribute and threshold, a case visits only the splits where it goes right and clears the leaves 
+	//it cannot reach. Trees with more than QS_MAX_LEAFN leaves are still traversed node by node
+	void useQuickScorer();
+
+	//returns the number of trees handled by QuickScorer
+	int getQSTreeN();
+
+	//outputs C++ source of a function that calculates the same predictions multiplied by leafCoef,
+	//attrNames are used in comments
+	void genCode(ostream& fcode, string funcName, double leafCoef, stringv& attrNames);
+
+	//saves the model into a file of version 2. Caller sets attrHash and training parameters in the header,
+	//dirs are directions on the training grid
+	void save(ostream& fsave, ModelFileHeader& header, boolv& dirs);
+
+	//maps a model file of version 2 into memory, predictions are calculated directly from the mapped arrays.
+	//Returns the header and directions on the training grid. Trees can not be added to a mapped model
+	void map(const char* fileName, ModelFileHeader& header, boolv& dirs);
+
+	//checks whether a file starts with the header of a model file of version 2
+	static bool isMappable(const char* fileName);
+
+	//saves all trees in the format of a model file of version 1: nodes of every tree in preorder
+	void saveTrees(ostream& fsave);
+
+	//checks that all split attributes are active in the data
+	bool activeAttrs(INDdata& data);
+
+	//builds the model as a compacted copy of source: a single group of trees with leaf values multiplied by 
+	//leafCoef. Splits with identical subtrees are removed, constant trees are merged into one tree, identical 
+	//trees are merged into one with multiplied leaf values. Predictions differ from the source only by rounding
+	void compact(CCompiledModel& source, double leafCoef);
+
+	//returns the number of trees
+	int getTreeN() {return treeN;}
+
+	//returns the number of groups
+	int getGroupN() {return groupN;}
+
+	//constructor
+	CCompiledModel();
+
+	//destructor
+	~CCompiledModel();
+
+	//returns the number of nodes in all trees
+	int getNodeN() {return nodeN;}
+
+private:
+	//calculates prediction of a single tree
+	double treePredict(int nodeNo, const float* row);
+
+	//calculates prediction of a subtree for a case with missing values, which can end up in several leaves.
+	//Adds leaf values multiplied by their coefficients to sum in the same order as CTreeNode based prediction
+	void predictMV(int nodeNo, const float* row, double coef, double& sum);
+
+	//calculates predictions for a block of at most BATCH_ROWN cases, block contains their attribute values 
+	//column by column. Cases with missing values are skipped, their predictions should be calculated by predict
+	void predictBlock(const float* block, int rowN, double* preds);
+
+	//calculates prediction for a case without missing values with QuickScorer, 
+	//bits is a working buffer with a bit vector for every tree
+	double predictQS(const float* row, leafmask* bits);
+
+	//collects QuickScorer splits and leaves of a subtree, returns the range of its leaves in the tree
+	iipair qsNode(int nodeNo, int treeNo, int& leafN, vector<QSSplit>& splits);
+
+	//outputs C++ code of a subtree as nested if-else statements
+	void nodeCode(ostream& fcode, int nodeNo, int level, double leafCoef);
+
+	//points arrays used in prediction to the vectors
+	void setArrays();
+
+	//fills batch copies and depth of the last added tree, rootNo is its root
+	void finishTree(int rootNo);
+
+	//returns a key that is the same for identical subtrees, keys of children should be already set
+	string nodeKey(int nodeNo, stringv& keys);
+
+	//sets keys of all nodes of a tree, returns the number of the node after its last node
+	int setKeys(int treeNo, stringv& keys);
+
+	//skips splits with identical subtrees, returns the first node that is a leaf or has different subtrees
+	int skipSame(int nodeNo, stringv& keys);
+
+	//the model can own a mapped file, it should not be copied
+	CCompiledModel(const CCompiledModel&);
+	CCompiledModel& operator=(const CCompiledModel&);
+
+private:
+	CompiledNodev nodes;	//nodes of all trees
+	doublev missingL;		//proportions of missing values going to the left for all nodes
+	doublev leafVals;		//values of all leaves
+	intv roots;				//root nodes of trees
+	intv groupStarts;		//first tree of every group
+	intv depths;			//depths of trees
+	doublev borders;		//original split points of all nodes, 0 for leaves
+
+	//copies of node fields used by predictBatch. In these copies a leaf points to itself as a child and 
+	//has an infinite threshold, so that a block of cases can go down all trees for the same number of steps
+	intv batchAttr;			//split attributes
+	floatv batchThresh;		//thresholds
+	intv batchChild;		//left children
+	int attrN;				//number of attributes used by the trees + 1
+
+	//arrays used in prediction, they point either to the vectors above or into a mapped model file
+	const CompiledNode* pNodes;
+	const double* pMissingL;
+	const double* pLeafVals;
+	const int* pRoots;
+	const int* pGroupStarts;
+	const int* pDepths;
+	const double* pBorders;
+	const int* pBatchAttr;
+	const float* pBatchThresh;
+	const int* pBatchChild;
+	int nodeN;				//number of nodes
+	int treeN;				//number of trees
+	int groupN;				//number of groups
+	char* mapData;			//mapped model file, NULL if the model was built from trees
+	size_t mapSize;			//size of the mapped file
+
+	//QuickScorer structures, splits of all trees sorted by attribute and threshold
+	bool useQS;				//predict with QuickScorer
+	floatv qsThresh;		//thresholds of splits
+	intv qsTree;			//trees of splits
+	vector<leafmask> qsMask;	//masks of splits
+	intv qsAttrStarts;		//first split of every attribute, attrN + 1 values
+	intv qsLeafStarts;		//first leaf of every tree in qsLeafVals, -1 if the tree has too many leaves
+	doublev qsLeafVals;		//leaf values of all trees, from left to right
+};
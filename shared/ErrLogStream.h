@@ -1,5 +1,5 @@
 // ErrLogStream.h: implementation of ErrLogStream class and << operator
-// Redirects output to both cerr (console error output) and file log.txt
+// Redirects output to both cerr (console error output) and file log.txt (through the buffer of LogStream)
 // (c) Daria Sorokina
 
 #pragma once
@@ -7,6 +7,8 @@
 #include <fstream>
 #include <iostream>
 
+#include "LogStream.h"
+
 class ErrLogStream
 {
 };	
@@ -17,9 +19,10 @@ ErrLogStream& operator << (ErrLogStream& errlogout, T& data)
 	cerr << data;
 	cerr.flush();
 
-	fstream fout;
-	fout.open("log.txt", ios_base::out | ios_base::app);
-	fout << data;
-	fout.close();
+	//error messages go to the log file right away
+	LogStream::lock();
+	LogStream::buffer << data;
+	LogStream::unlock();
+	LogStream::flush();
 	return errlogout;
 }
@@ -233,6 +233,21 @@ INDdata::INDdata(const char* trainFName, const char* validFName, const char* tes
 //hasMV (class member) value becomes true if there are missing values (otherwise not changed)
 void INDdata::readData(char* buf, streamsize buflen, floatv& retv, int retvlen)
 {
+	if(parseLine(buf, buflen, retv, retvlen))
+		hasMV = true;
+}
+
+//Converts a line in the format of the test set into attribute values, the response is removed
+void INDdata::parseRow(char* buf, streamsize buflen, floatv& row)
+{
+	parseLine(buf, buflen, row, attrN + 1);
+	row.erase(row.begin() + tarColNo);
+}
+
+//Gets a line of text, returns a vector with data points. Returns true if there are missing values
+bool INDdata::parseLine(char* buf, streamsize buflen, floatv& retv, int retvlen)
+{
+	bool lineMV = false;
 	//remove spaces (there can be spaces in nominal values, space should not be a delimiter
 	//and also should be ignored when it is next to a number)
 
@@ -259,13 +274,48 @@ void INDdata::readData(char* buf, streamsize buflen, floatv& retv, int retvlen)
 		else //missing value
 		{
 			retv[attrId] = QNAN;
-			hasMV = true;
+			lineMV = true;
 		}
 	}
 
 	itemstr >> singleItem;
 	if(!itemstr.fail())
 	  throw ATTR_DATA_MISMATCH_G_ERR;
+	return lineMV;
+}
+
+//Replaces the test set with the next chunk of at most maxN cases read from a stream, used for 
+//processing test sets that do not fit into memory. Returns the number of cases read, 0 at the end of the stream.
+//lineNo is the number of lines read from the stream so far, it is used in error messages
+int INDdata::readTestChunk(istream& fin, int maxN, int& lineNo)
+{
+	//rows of the previous chunk are reused, so memory is allocated only for the first chunk
+	if((int)test.size() < maxN)
+		test.resize(maxN);
+	testTar.resize(maxN);
+
+	char buf[LINE_LEN];	//buffer for reading from the input stream
+	int caseNo;
+	for(caseNo = 0; caseNo < maxN; caseNo++)
+	{
+		getLineExt(fin, buf);
+		if(!fin.gcount())
+			break;
+		lineNo++;
+
+		try {
+			readData(buf, fin.gcount(), test[caseNo], attrN + 1);
+		} catch (TE_ERROR err) {
+			cerr << "\nLine " << lineNo << "\n";
+			throw err;
+		}
+
+		testTar[caseNo] = test[caseNo][tarColNo];
+		test[caseNo].erase(test[caseNo].begin() + tarColNo);
+	}
+	testN = caseNo;
+	testTar.resize(testN);
+	return testN;
 }
 
 //Puts bootstrapped ids (indices) of train set data points into bootstrap vector
@@ -452,6 +502,14 @@ void INDdata::getSortedData(fipairvv& sorted)
 	sorted = sortedItems;
 }
 
+//Creates a standalone copy of the current bag: bootstrap, out-of-bag data and sorted indexes
+void INDdata::getBag(BagInfo& bag)
+{
+	getCurBag(bag.bootstrap, bag.bagTar);
+	getOutOfBag(bag.oobData, bag.oobTar);
+	getSortedData(bag.sortedItems);
+}
+
 //gets the value of a given attribute (attrId) for a given case (itemNo) in a given data set (dset)
 //returns whether the value in question is defined
 double INDdata::getValue(int itemNo, int attrId, DATA_SET dset)
@@ -466,6 +524,17 @@ double INDdata::getValue(int itemNo, int attrId, DATA_SET dset)
 		return valid[itemNo][attrId];
 }
 
+//gets values of all attributes for a given case in a given data set
+const float* INDdata::getRow(int itemNo, DATA_SET dset)
+{
+	if(dset == TRAIN)
+		return &train[itemNo][0];
+	else if(dset == TEST)
+		return &test[itemNo][0];
+	else //if(dset == VALID)
+		return &valid[itemNo][0];
+}
+
 //checks if target values are present for test data 
 bool INDdata::hasTrueTest()
 {
@@ -481,6 +550,30 @@ string INDdata::getAttrName(int attrId)
 	return attrNames[attrId];
 }
 
+//returns a hash (32 bit FNV-1a) of names and types of all attributes in the order of the attribute file
+unsigned int INDdata::getAttrHash()
+{
+	string schema;
+	for(int attrNo = 0; attrNo < attrN; attrNo++)
+	{
+		schema += attrNames[attrNo];
+		if(boolAttr(attrNo))
+			schema += ": 0,1\n";
+		else if(nomAttrs.find(attrNo) != nomAttrs.end())
+			schema += ": nom\n";
+		else
+			schema += ": cont\n";
+	}
+
+	unsigned int hash = 2166136261u;
+	for(int charNo = 0; charNo < (int)schema.size(); charNo++)
+	{
+		hash ^= (unsigned char)schema[charNo];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 //returns std of response values
 double INDdata::getTarStD(DATA_SET ds)
 {
@@ -4,6 +4,7 @@
 
 #pragma once
 #include "ItemInfo.h"
+#include "BagInfo.h"
 
 class INDdata
 {
@@ -38,12 +39,21 @@ public:
 	//gets sorted indexes of current training data
 	void getSortedData(fipairvv& sorted);
 
+	//gets a standalone copy of the current bag
+	void getBag(BagInfo& bag);
+
 	//gets a value of a given attribute for a given case in a given data set
 	double getValue(int itemNo, int attrId, DATA_SET dset);
 
+	//gets values of all attributes for a given case in a given data set
+	const float* getRow(int itemNo, DATA_SET dset);
+
 	//returns the name of the attribute by its number
 	string getAttrName(int attrId);
 
+	//returns a hash of names and types of all attributes, saved in model files to check that they match
+	unsigned int getAttrHash();
+
 	//returns counts and quantile values
 	int getQuantiles(int attrId, int& quantN, dipairv& valCounts);
 
@@ -75,6 +85,13 @@ public:
 	//inserts a new data point into the data set
 	int addTestItem(idpairv& values); 
 
+	//replaces the test set with the next chunk of at most maxN cases read from a stream
+	int readTestChunk(istream& fin, int maxN, int& lineNo);
+
+	//converts a line in the format of the test set into attribute values without the response,
+	//does not change the data, so it can be called from several threads
+	void parseRow(char* buf, streamsize buflen, floatv& row);
+
 	//outputs a version of attribute file where only a predefined set of features is active
 	void outAttr(string attrFName);
 
@@ -88,6 +105,9 @@ private:
 	//gets a line of text, returns a vector with data points
 	void readData(char* buf, streamsize buflen, floatv& retv, int retvlen); 
 
+	//same as readData, returns true if there are missing values instead of setting hasMV
+	static bool parseLine(char* buf, streamsize buflen, floatv& retv, int retvlen);
+
 	//create versions of bootstrap data sorted by active continuous attributes 
 	void sortItems(); 
 
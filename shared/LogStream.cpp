@@ -5,16 +5,170 @@
 #include "LogStream.h"
 #include "definitions.h"
 
-//static variable
+#include <exception>
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+//the buffer is written to the file without waiting for the background thread when it gets this large
+#define LOG_BUFFER_SIZE 65536
+
+//static variables
 bool LogStream::doOut = true;
+string LogStream::fileName = "log.txt";
+ostringstream LogStream::buffer;
+ofstream LogStream::fout;
+bool LogStream::isOpen = false;
+void (*LogStream::prevTerminate)() = NULL;
+#ifndef _WIN32
+pthread_mutex_t LogStream::mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t LogStream::wakeUp = PTHREAD_COND_INITIALIZER;
+pthread_t LogStream::writerThread;
+pthread_once_t LogStream::startOnce = PTHREAD_ONCE_INIT;
+bool LogStream::writerOn = false;
+bool LogStream::stopWriter = false;
+#endif
+//defined last, so that it is destroyed before the buffer and the file
+LogStream::Closer LogStream::closer;
 
 //static initialization, needs to be called once in the whole program
 void LogStream::init(bool doOut_in)
 { 
 	doOut = doOut_in;
-	fstream fout; 
-	fout.open("log.txt", ios_base::out); 
-	fout.close(); 
+	lock();
+	buffer.str("");
+	if(isOpen)
+		fout.close();
+	fout.open(fileName.c_str(), ios_base::out); 
+	isOpen = true;
+	unlock();
+}
+
+//sets the directory for the log file
+void LogStream::setDir(string dirName)
+{
+	lock();
+	drain();
+	if(isOpen)
+	{
+		fout.close();
+		isOpen = false;
+	}
+	fileName = dirName + "/log.txt";
+	unlock();
+}
+
+//writes the buffered output to the log file
+void LogStream::flush()
+{
+	lock();
+	drain();
+	unlock();
+}
+
+//locks the buffer, starts the background thread on the first output
+void LogStream::lock()
+{
+#ifndef _WIN32
+	//several threads can make the first output at the same time, only one of them starts the log
+	pthread_once(&startOnce, start);
+	pthread_mutex_lock(&mutex);
+#else
+	if(prevTerminate == NULL)
+		start();
+#endif
+}
+
+//sets the terminate handler and starts the background thread, called once before the first output
+void LogStream::start()
+{
+	prevTerminate = set_terminate(onTerminate);
+#ifndef _WIN32
+	stopWriter = false;
+	writerOn = (pthread_create(&writerThread, NULL, writer, NULL) == 0);
+#endif
+}
+
+//unlocks the buffer, writes it to the file if it is too large
+void LogStream::unlock()
+{
+	if(buffer.tellp() > LOG_BUFFER_SIZE)
+		drain();
+#ifndef _WIN32
+	pthread_mutex_unlock(&mutex);
+#endif
+}
+
+//writes the buffer to the log file, the lock should be held
+void LogStream::drain()
+{
+	if(buffer.tellp() <= 0)
+		return;
+
+	if(!isOpen)
+	{
+		fout.open(fileName.c_str(), ios_base::out | ios_base::app);
+		isOpen = true;
+	}
+	fout << buffer.str();
+	fout.flush();
+	buffer.str("");
 }
 
+//flushes the log before the program is terminated by an unhandled exception
+void LogStream::onTerminate()
+{
+#ifndef _WIN32
+	//the lock might be held by the terminating thread itself
+	if(pthread_mutex_trylock(&mutex) == 0)
+	{
+		drain();
+		pthread_mutex_unlock(&mutex);
+	}
+#else
+	drain();
+#endif
+	if(prevTerminate != NULL)
+		prevTerminate();
+	abort();
+}
 
+#ifndef _WIN32
+//background thread function, writes the buffer once a second until asked to stop
+void* LogStream::writer(void*)
+{
+	pthread_mutex_lock(&mutex);
+	while(!stopWriter)
+	{
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		struct timespec wakeTime;
+		wakeTime.tv_sec = now.tv_sec + 1;
+		wakeTime.tv_nsec = now.tv_usec * 1000;
+		pthread_cond_timedwait(&wakeUp, &mutex, &wakeTime);
+		drain();
+	}
+	pthread_mutex_unlock(&mutex);
+	return NULL;
+}
+#endif
+
+//flushes the log and stops the background thread when the program exits
+LogStream::Closer::~Closer()
+{
+#ifndef _WIN32
+	if(writerOn)
+	{
+		pthread_mutex_lock(&mutex);
+		stopWriter = true;
+		pthread_cond_signal(&wakeUp);
+		pthread_mutex_unlock(&mutex);
+		pthread_join(writerThread, NULL);
+		writerOn = false;
+	}
+#endif
+	drain();
+	if(isOpen)
+		fout.close();
+}
@@ -6,29 +6,75 @@
 
 #include <fstream>
 #include <iostream>
+#include <sstream>
 
 #include "definitions.h"
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+//The log file is kept open, output is collected in a memory buffer and written to the file in large chunks:
+//once a second by a background thread (linux version), when the buffer grows large, 
+//after error messages and on exit
 class LogStream
 {
 public:
 	//Clears or creates log.txt file. Should be called once in the whole program.
 	static void init(bool doOut_in);
+	//Keeps log.txt in the given directory instead of the current one. Should be called before init.
+	static void setDir(string dirName);
+	//writes the buffered output to the log file
+	static void flush();
 	static bool doOut; //turns on/off console output
+	static string fileName; //path to the log file
+
+	//access to the buffer is shared with the background thread
+	static void lock();
+	static void unlock();
+	static ostringstream buffer; //output not written to the log file yet
+
+private:
+	//writes the buffer to the log file, the lock should be held
+	static void drain();
+	//flushes the log before the program is terminated by an unhandled exception
+	static void onTerminate();
+	//sets the terminate handler and starts the background thread
+	static void start();
+
+	static ofstream fout;		//log file
+	static bool isOpen;			//whether the log file was opened already
+	static void (*prevTerminate)();	//terminate handler that was set before the log was started
+#ifndef _WIN32
+	//background thread function, writes the buffer once a second
+	static void* writer(void* param);
+
+	static pthread_mutex_t mutex;	//protects the buffer and the log file
+	static pthread_cond_t wakeUp;	//signals the background thread to stop waiting
+	static pthread_t writerThread;	//background thread
+	static bool writerOn;			//whether the background thread is running
+	static pthread_once_t startOnce;	//makes sure that the background thread is started only once
+	static bool stopWriter;			//asks the background thread to finish
+#endif
+
+	//flushes the log and stops the background thread when the program exits
+	class Closer
+	{
+	public:
+		~Closer();
+	};
+	static Closer closer;
+	friend class Closer;
 };	
 
 template <class T>
 LogStream& operator << (LogStream& logcout, T data)
 {
 	if(LogStream::doOut)
-	{
 		cout << data;
-		cout.flush();
-	}
 
-	fstream fout;
-	fout.open("log.txt", ios_base::out | ios_base::app);
-	fout << data;
-	fout.close();
+	LogStream::lock();
+	LogStream::buffer << data;
+	LogStream::unlock();
 	return logcout;
 }
@@ -24,7 +24,8 @@ INDdata* CTreeNode::pData;
 
 //Constructor. If the node is a root, download info about the train set.
 CTreeNode::CTreeNode(): 
-	left(0), right(0), pAttrs(NULL), pSorted(NULL), pItemSet(NULL)
+	left(0), right(0), pAttrs(NULL), pSorted(NULL), pItemSet(NULL), pLeafItems(NULL), seed(0), 
+	keepLeafItems(false)
 {
 	
 }
@@ -39,6 +40,8 @@ CTreeNode::~CTreeNode()
 		delete pAttrs;
 	if(pSorted)
 		delete pSorted;
+	if(pLeafItems)
+		delete pLeafItems;
 }
 
 //Deletes a subtree with a root in this node. It is recursive because it calls destructor.
@@ -87,12 +90,21 @@ CTreeNode& CTreeNode::operator=(const CTreeNode& rhs)
 	else
 		pSorted = NULL;
 
+	if(pLeafItems)
+		delete pLeafItems;
+	if(rhs.pLeafItems)
+		pLeafItems = new ItemInfov(*rhs.pLeafItems);
+	else
+		pLeafItems = NULL;
+
 	//copy pointers to subtrees and dataset class
 	left = rhs.left;		
 	right = rhs.right;		
 
 	//copy nonpointer contents
 	splitting = rhs.splitting;
+	seed = rhs.seed;
+	keepLeafItems = rhs.keepLeafItems;
 
 	return *this;
 }
@@ -117,12 +129,19 @@ CTreeNode::CTreeNode(const CTreeNode& rhs)
 	else
 		pSorted = NULL;
 
+	if(rhs.pLeafItems)
+		pLeafItems = new ItemInfov(*rhs.pLeafItems);
+	else
+		pLeafItems = NULL;
+
 	//copy pointers to subtrees and dataset class
 	left = rhs.left;		
 	right = rhs.right;		
 
 	//copy nonpointer contents
 	splitting = rhs.splitting;
+	seed = rhs.seed;
+	keepLeafItems = rhs.keepLeafItems;
 }
 
 //Deletes old tree, gets data from the dataset container into the node 
@@ -130,6 +149,7 @@ CTreeNode::CTreeNode(const CTreeNode& rhs)
 void CTreeNode::setRoot()
 {
 	del();	//delete old tree
+	clearLeafItems();
 
 	if(pAttrs == NULL)
 		pAttrs = new intv();
@@ -144,6 +164,25 @@ void CTreeNode::setRoot()
 	pData->getCurBag(*pItemSet);
 }
 
+//Initializes fresh root with data from a standalone bag
+void CTreeNode::setRoot(BagInfo& bag)
+{
+	del();	//delete old tree
+	clearLeafItems();
+
+	if(pAttrs == NULL)
+		pAttrs = new intv();
+	pData->getActiveAttrs(*pAttrs);
+
+	if(pSorted == NULL)
+		pSorted = new fipairvv();
+	bag.getSortedData(*pSorted);
+	
+	if(pItemSet == NULL)
+		pItemSet = new ItemInfov();
+	bag.getCurBag(*pItemSet);
+}
+
 //input: predictions for train set data points produced by the rest of the model (not by this tree)	
 //Changes ground truth to residuals in the root train set
 void CTreeNode::resetRoot(doublev& othpreds)
@@ -170,6 +209,26 @@ void CTreeNode::traverse(int itemNo, double inCoef, double& lOutCoef, double& rO
 	rOutCoef = rCoef * inCoef;
 }
 
+//Sends a case down the subtree without containers. Split rules are the same as in SplitInfo::leftCoef,
+//a case without missing values on its path ends up in a single leaf with coefficient 1
+CTreeNode* CTreeNode::findLeaf(const float* row)
+{
+	CTreeNode* pNode = this;
+	while(!pNode->isLeaf())
+	{
+		double value = row[pNode->splitting.divAttr];
+		if(wxisNaN(value))
+			return NULL;	//the case can go both ways, the caller should use traverse
+
+		//absence of border value indicates a split non-missing vs missing, non-missing values go left
+		if(wxisNaN(pNode->splitting.border) || (value <= pNode->splitting.border))
+			pNode = pNode->left;
+		else
+			pNode = pNode->right;
+	}
+	return pNode;
+}
+
 
 // Grows 2 child nodes of this node, using RMSE as split quality criterion
 // Returns true if succeeds, false if this node becomes a leaf
@@ -204,6 +263,12 @@ bool CTreeNode::split(double alpha)
 	left = new CTreeNode();
 	right = new CTreeNode();
 
+	//children get their own seeds, so that ties are broken the same way whatever order nodes are split in
+	left->seed = mix32(2 * seed + 1);
+	right->seed = mix32(2 * seed + 2);
+	left->keepLeafItems = keepLeafItems;
+	right->keepLeafItems = keepLeafItems;
+
 	int itemN = (int)pItemSet->size();
 
 	left->pItemSet = new ItemInfov();
@@ -354,13 +419,25 @@ void CTreeNode::makeLeaf(double nodeMean)
 		delete pSorted;
 	pSorted = NULL;
 
-	if(pItemSet)
+	//if requested, the train subset is kept as a list of cases that ended up in this leaf
+	clearLeafItems();
+	if(keepLeafItems)
+		pLeafItems = pItemSet;
+	else if(pItemSet)
 		delete pItemSet;
 	
 	pItemSet = new ItemInfov(1);
 	(*pItemSet)[0].response = nodeMean;
 }
 
+//Frees the list of train set cases of this leaf
+void CTreeNode::clearLeafItems()
+{
+	if(pLeafItems)
+		delete pLeafItems;
+	pLeafItems = NULL;
+}
+
 //Chooses and sets best mse split over all attributes and values when no missing values are
 // present.
 //To compare mse values of splits, we need to calculate only 2 of 3 squared sum components.
@@ -521,7 +598,7 @@ bool CTreeNode::setSplit(double nodeV, double nodeSum)
 	if(!wxisNaN(bestEval))
 	{
 		int bestSplitN = (int)bestSplits.size();
-		int randSplit = rand() % bestSplitN;
+		int randSplit = (int)(seed % bestSplitN);
 		splitting = bestSplits[randSplit];
 
 		if(pData->boolAttr(splitting.divAttr))
@@ -727,7 +804,7 @@ bool CTreeNode::setSplitMV(double nodeV, double nodeSum)
 	if(!wxisNaN(bestEval))
 	{
 		int bestSplitN = (int)bestSplits.size();
-		int randSplit = rand() % bestSplitN;
+		int randSplit = (int)(seed % bestSplitN);
 		splitting = bestSplits[randSplit];
 	}
 	return wxisNaN(bestEval);
@@ -823,7 +900,7 @@ double CTreeNode::evalBoolMV(SplitInfo& canSplit, double nodeV, double nodeSum,
 
 //dumps the node contents into a binary file
 //links to other nodes are not saved, the tree will be reconstructed from the order of nodes 
-void CTreeNode::save(fstream& fsave)
+void CTreeNode::save(ostream& fsave)
 {
 	//first bit indicates whether the node is a leaf: required for reconstructing tree structure
 	bool leaf = isLeaf();
@@ -843,7 +920,7 @@ void CTreeNode::save(fstream& fsave)
 
 //loads the node from a binary file
 //returns true if the node is a leaf
-bool CTreeNode::load(fstream& fload)
+bool CTreeNode::load(istream& fload)
 {
 	del();
 
@@ -855,6 +932,7 @@ bool CTreeNode::load(fstream& fload)
 		double prediction;
 		fload.read((char*) &prediction, sizeof(double));
 		makeLeaf(prediction);
+		clearLeafItems();
 	}
 	else		
 	{			//load splitting 
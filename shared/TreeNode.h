@@ -35,11 +35,21 @@ public:
 	//get functions 
 	int getDivAttr() {return splitting.divAttr;}
 	double getThresh() {return splitting.border;}
+	double getMissingL() {return splitting.missingL;}
 	double getResp() {return (*pItemSet)[0].response;} //should be applied to leaves only
 	double getNodeV();
 	//initializes fresh root
 	void setRoot();
 
+	//initializes fresh root with a given bag of data instead of the current one
+	void setRoot(BagInfo& bag);
+
+	//sets the seed used to break ties between equally good splits in this node and its subtree
+	void setSeed(unsigned int seedIn) {seed = seedIn;}
+
+	//sets whether leaves of this node's subtree keep lists of train set cases that ended up in them
+	void setKeepLeafItems(bool keep) {keepLeafItems = keep;}
+
 	//changes train set responses to residuals
 	void resetRoot(doublev& othpreds);
 
@@ -49,17 +59,27 @@ public:
 	//checks if a node is a leaf
 	bool isLeaf() {return left == NULL;}
 
+	//returns train set cases that ended up in this leaf during training, NULL if not available
+	ItemInfov* getLeafItems() {return pLeafItems;}
+
+	//frees the list of train set cases of this leaf
+	void clearLeafItems();
+
 	//sends a test case down the tree (used in generating prediction for the test case)
 	void traverse(int itemNo, double coef, double& ltCoef, double& rtCoef, DATA_SET dset);
 
+	//sends a case down the subtree along a single path, row contains values of all attributes of the case.
+	//Returns the leaf where it ends up or NULL if the case has a missing value of a split attribute on the path
+	CTreeNode* findLeaf(const float* row);
+
 	//splits the node; grows two offsprings 
 	bool split(double alpha);
 
-	//saves the node into a binary file
-	void save(fstream& fsave);
+	//saves the node into a binary file or a memory buffer
+	void save(ostream& fsave);
 
-	//loads the node from a binary file
-	bool load(fstream& fload);
+	//loads the node from a binary file or a memory buffer
+	bool load(istream& fload);
 
 	
 private:
@@ -69,7 +89,7 @@ private:
 	//returns several summaries of the prediction values set in this node
 	bool getStats(double& nodeV, double& nodeSum, double& realNodeV);
 
-	//cleans training data out of a leaf
+	//cleans training data out of a leaf, keeps the list of cases that ended up in it
 	void makeLeaf(double nodeMean); 
 
 	//finds and sets a splitting info with the best MSE
@@ -94,6 +114,9 @@ private:
 	fipairvv*   pSorted;	//current itemset indexes sorted by value of attribute
 	intv*		pAttrs;		//set of valid attributes in the node	
 	SplitInfo	splitting;	//split (attribute, split point, proportion for missing values)
+	ItemInfov*	pLeafItems;	//train set cases (ids and coefficients) that ended up in this leaf during training
+	unsigned int seed;		//seed for breaking ties between splits, children get seeds derived from it
+	bool keepLeafItems;		//leaves keep their train set cases in pLeafItems, children inherit it
 
 };
 
@@ -28,8 +28,10 @@ typedef vector<doublev> doublevv;
 typedef vector<doublevv> doublevvv;
 typedef vector<float> floatv;
 typedef vector<floatv> floatvv;
+typedef vector<floatvv> floatvvv;
 typedef vector<string> stringv;
 typedef vector<bool> boolv;
+typedef vector<boolv> boolvv;
 
 typedef pair<double, int> dipair;
 typedef pair<float, int> fipair;
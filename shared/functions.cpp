@@ -9,6 +9,11 @@
 #include <fstream>
 #include <math.h>
 #include <algorithm>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
 
 //Deletes spaces from the beginning and from the end of the string
 //By "spaces" I mean spaces only, not white spaces
@@ -195,7 +200,7 @@ bool moreBag(doublev bagPerf)
 }
 
 //extends fstream::getline with check on exceeding the buffer size
-std::streamsize getLineExt(fstream& fin, char* buf)
+std::streamsize getLineExt(istream& fin, char* buf)
 {
 	fin.getline(buf, LINE_LEN);
 	std::streamsize bufLen = fin.gcount();
@@ -437,3 +442,34 @@ double rand_coef()
 		return (double) ((rand() << int(log(RAND_MAX + 1.0) / log(2.0) + 0.5)) + rand() ) / ((RAND_MAX + 1) * (RAND_MAX + 1) - 1);
 #endif
 }
+
+//mixes bits of a 32-bit integer
+unsigned int mix32(unsigned int x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352dU;
+	x ^= x >> 15;
+	x *= 0x846ca68bU;
+	x ^= x >> 16;
+	return x;
+}
+
+//returns a seed of the random number generator for a given bagging iteration.
+//The generator is reseeded on every iteration, so that training can be resumed from any iteration 
+//with the same results. Different seeds give unrelated sequences of bagging iterations
+unsigned int bagSeed(int seed, int bagNo)
+{
+	return mix32(mix32((unsigned int)seed) + (unsigned int)bagNo);
+}
+
+//returns wall clock time in seconds
+double getTime()
+{
+#ifndef _WIN32
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec / 1e6;
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
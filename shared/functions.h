@@ -29,8 +29,8 @@ string alphaToStr(double alpha);
 //checks if more bagging will benefit the performance
 bool moreBag(doublev bagPerf);
 
-//extends fstream::getline with check on exceeding the buffer size
-std::streamsize getLineExt(fstream& fin, char* buf);
+//extends istream::getline with check on exceeding the buffer size
+std::streamsize getLineExt(istream& fin, char* buf);
 
 //outputs error messages for shared TreeExtra errors
 void te_errMsg(TE_ERROR err);
@@ -55,4 +55,13 @@ double atofExt(char* str);
 double diff10d(double d1, double d2);
 
 //returns random double between 0 and 1
-double rand_coef();
\ No newline at end of file
+double rand_coef();
+
+//mixes bits of a 32-bit integer, used to derive independent seeds from each other
+unsigned int mix32(unsigned int x);
+
+//returns a seed of the random number generator for a given bagging iteration
+unsigned int bagSeed(int seed, int bagNo);
+
+//returns wall clock time in seconds, used to measure speed
+double getTime();
\ No newline at end of file